@@ -66,6 +66,26 @@
  *          --syslog-target=HOST:PORT  also send syslog msgs to HOST:PORT via UDP
  *
  *     Other options:
+ *          --poll-budget=MSEC      i2c time budget per bus per wakeup
+ *                                  (0: unlimited)
+ *          --shard=ID/COUNT        serve only the subsystems of shard ID
+ *                                  out of COUNT
+ *          --metrics=SOCKET        serve OpenMetrics on unix SOCKET
+ *                                  (default: /var/run/openvswitch/ops-powerd.metrics,
+ *                                  with .shard<ID> appended with --shard)
+ *          --record=FILE           record every register access to FILE
+ *          --replay=FILE           answer register accesses from a trace
+ *                                  recorded with --record
+ *          --replay-fast           replay without the recorded timing
+ *          --watchdog=MSEC         report main loop iterations longer
+ *                                  than MSEC (0: disabled)
+ *          --watchdog-abort        with --watchdog, abort on a stall
+ *          --timer-slack=MSEC      let wakeups be delayed by up to MSEC
+ *                                  to coalesce them (0: kernel default)
+ *          --single-reads          read each register bit on its own
+ *                                  instead of once per register
+ *          --parse-all-devices     parse every device of the devices
+ *                                  files, not just those of the psus
  *          --unixctl=SOCKET        override default control socket name
  *          -h, --help              display this help message
  *          -V, --version           display version information
@@ -74,6 +94,13 @@
  * ovs-apptcl options:
  *
  *      Support dump: ovs-appctl -t ops-powerd ops-powerd/dump
+ *      Metrics:      ovs-appctl -t ops-powerd ops-powerd/metrics
+ *      Profile:      ovs-appctl -t ops-powerd ops-powerd/profile
+ *      Fault injection:
+ *          ovs-appctl -t ops-powerd ops-powerd/test PSU STATUS
+ *          ovs-appctl -t ops-powerd ops-powerd/scenario-load FILE
+ *          ovs-appctl -t ops-powerd ops-powerd/scenario-show
+ *          ovs-appctl -t ops-powerd ops-powerd/scenario-stop
  *
  *
  * OVSDB elements usage
@@ -85,18 +112,42 @@
  *
  *     Written: The following cols are written by ops-powerd
  *              Power_supply:status
+ *              Power_supply:external_ids:degraded
+ *              Power_supply:external_ids:status_changed
+ *              Power_supply:external_ids:status_transitions
+ *              Power_supply:external_ids:powerd_owner
  *              subsystem:power_supplies
+ *              subsystem:external_ids:power_redundancy
+ *              subsystem:external_ids:power_psus_ok
+ *              subsystem:external_ids:power_capacity_watts
  *              daemon["ops-powerd"]:cur_hw
  *
  *     Read: The following cols are read by ops-powerd
  *           subsystem:name
  *           subsystem:hw_desc_dir
+ *           subsystem:other_config:power_polling_period
+ *           subsystem:other_config:power_psu_rated_watts
+ *           subsystem:other_config:power_psus_required
+ *           subsystem:other_config:power_deadband_watts
+ *           subsystem:other_config:power_shard
+ *           subsystem:other_config:power_degraded_flap_rate
+ *           subsystem:other_config:power_degraded_fail_rate
+ *           subsystem:other_config:power_degraded_flicker
  *
  * Linux Files:
  *
  *     The following files are written by ops-powerd
  *           /var/run/openvswitch/ops-powerd.pid: Process ID for the ops-powerd daemon
  *           /var/run/openvswitch/ops-powerd.<pid>.ctl: unixctl socket for the ops-powerd daemon
+ *           /var/run/openvswitch/ops-powerd.<pid>.desc/<subsystem>/: hardware
+ *           description of a subsystem with its devices file pruned
+ *           /dev/shm/ops-powerd.psu (ops-powerd.psu.shard<ID> with --shard):
+ *           shared memory snapshot of the psu state, see powerd_shm.h
+ *
+ *     The following files are read by ops-powerd, and read again when
+ *     they change
+ *           <hw_desc_dir>/devices.yaml, psu.yaml, thermal.yaml: hardware
+ *           description of each subsystem
  *
  * @}
  ***************************************************************************/
@@ -107,16 +158,76 @@
 
 #include <stdbool.h>
 #include "shash.h"
+#include "token-bucket.h"
 #include "config-yaml.h"
+#include "powerd_desc.h"
 
 VLOG_DEFINE_THIS_MODULE(ops_powerd);
 
 COVERAGE_DEFINE(powerd_reconfigure);
+COVERAGE_DEFINE(powerd_txn_commit);
 
 #define NAME_IN_DAEMON_TABLE "ops-powerd" /*!< Name of daemon */
 
-#define POLLING_PERIOD  5     /*!< polling period in seconds */
+/* Power_supply:external_ids key naming the daemon that owns the row */
+#define POWER_OWNER_KEY "powerd_owner"
+
+/* Power_supply:external_ids keys holding the wall clock time (ms since the
+   epoch) of the last status transition and the number of transitions;
+   the time in the current status is derived from the former */
+#define STATUS_CHANGED_KEY      "status_changed"
+#define STATUS_TRANSITIONS_KEY  "status_transitions"
+
+#define POLLING_PERIOD  5     /*!< default polling period in seconds */
 #define MSEC_PER_SEC    1000  /*!< number of miliseconds in a second */
+#define POLLING_PERIOD_MIN  100 /*!< shortest polling period allowed (ms) */
+
+/* Subsystem:other_config key overriding the polling period (ms) */
+#define POLLING_PERIOD_KEY  "power_polling_period"
+
+#define POLL_BUDGET  100  /*!< default i2c time budget per wakeup (ms) */
+
+#define BOOTSTRAP_RETRY  1000 /*!< delay before retrying to add psu rows (ms) */
+
+#define DESC_DEVICES  0x1  /*!< devices file changed */
+#define DESC_POWER    0x2  /*!< power file changed */
+#define DESC_THERMAL  0x4  /*!< thermal file changed */
+
+#define DESC_DEBOUNCE  500 /*!< quiet time before reloading changes (ms) */
+
+#define HOTSWAP_ABSENT_PERIOD   250 /*!< polling period of absent psus (ms) */
+#define HOTSWAP_BURST_INTERVAL  50  /*!< time between settling reads (ms) */
+#define HOTSWAP_SETTLE_READS    3   /*!< equal reads that end the burst */
+#define HOTSWAP_BURST_MAX       20  /*!< most reads in one burst */
+
+/* Subsystem:other_config keys describing the power budget */
+#define POWER_RATED_WATTS_KEY   "power_psu_rated_watts"
+#define POWER_PSUS_REQUIRED_KEY "power_psus_required"
+#define POWER_DEADBAND_KEY      "power_deadband_watts"
+
+#define POWER_DEADBAND  10   /*!< default deadband for capacity updates (W) */
+
+/* Subsystem:other_config key assigning the subsystem to a shard */
+#define POWER_SHARD_KEY "power_shard"
+
+/* Subsystem:other_config keys with the psu degradation thresholds */
+#define DEGRADED_FLAP_KEY     "power_degraded_flap_rate"
+#define DEGRADED_FAIL_KEY     "power_degraded_fail_rate"
+#define DEGRADED_FLICKER_KEY  "power_degraded_flicker"
+
+#define DEGRADED_FLAP     0.10 /*!< default status changes per read */
+#define DEGRADED_FAIL     0.20 /*!< default failed reads per read */
+#define DEGRADED_FLICKER  0.05 /*!< default variance of input/output ok */
+#define DEGRADED_ALPHA    0.10 /*!< weight of a new sample in the EWMAs */
+
+/************************************************************************//**
+ * DEFINES for rate limiting psu status transition events. Each psu has its
+ * own token bucket, filled at PSU_EVENT_RATE events per minute, so that a
+ * flapping power supply cannot flood the event log.
+ ***************************************************************************/
+#define PSU_EVENT_TOKENS (60 * 1000) /*!< tokens consumed by one event */
+#define PSU_EVENT_RATE   6           /*!< sustained events per minute */
+#define PSU_EVENT_BURST  4           /*!< events allowed in a burst */
 
 /* psu status reported in DB (must match psu_status string array, below) */
 /************************************************************************//**
@@ -144,6 +255,37 @@ const char *psu_status[] =
     "unknown"        /*!< string value for PSU_STATUS_UNKNOWN */
 };
 
+/************************************************************************//**
+ * ENUM containing possible values for the power redundancy of a subsystem
+ ***************************************************************************/
+enum power_redundancy {
+    POWER_REDUNDANCY_N_PLUS_N = 0, /*!< twice the required psus are ok */
+    POWER_REDUNDANCY_N_PLUS_1 = 1, /*!< at least one spare psu is ok */
+    POWER_REDUNDANCY_N = 2,        /*!< exactly the required psus are ok */
+    POWER_REDUNDANCY_DEGRADED = 3  /*!< fewer than the required psus are ok */
+};
+
+/* must match power_redundancy enum */
+/************************************************************************//**
+ * Char_array containing string values for the power redundancy
+ ***************************************************************************/
+const char *power_redundancy_str[] =
+{
+    "n+n",           /*!< string value for POWER_REDUNDANCY_N_PLUS_N */
+    "n+1",           /*!< string value for POWER_REDUNDANCY_N_PLUS_1 */
+    "n",             /*!< string value for POWER_REDUNDANCY_N */
+    "degraded"       /*!< string value for POWER_REDUNDANCY_DEGRADED */
+};
+
+/************************************************************************//**
+ * STRUCT containing the exponentially weighted mean and variance of one
+ * psu health metric, each sample being 0 or 1
+ ***************************************************************************/
+struct powerd_ewma {
+    double mean;            /*!< weighted mean */
+    double var;             /*!< weighted variance */
+};
+
 /************************************************************************//**
  * STRUCT containing local copy of info for a subsystem
  ***************************************************************************/
@@ -152,6 +294,31 @@ struct locl_subsystem {
     bool marked;            /*!< flag for calculating "in use" status */
     bool valid;             /*!< flag to know if this is a valid subsys */
     enum psustatus status;  /*!< current power supply status */
+    int hw_polling_period;  /*!< polling period from hw desc (ms), or 0 */
+    int polling_period;     /*!< polling period in use (ms) */
+    const char *polling_source; /*!< where polling_period came from */
+    int n_psus_ok;              /*!< psus currently in PSU_STATUS_OK */
+    int psu_rated_watts;        /*!< rated output of one psu (W), or 0 */
+    int psus_required;          /*!< psus needed to power the subsystem */
+    int power_deadband;         /*!< capacity change worth publishing (W) */
+    enum power_redundancy redundancy;  /*!< current redundancy state */
+    bool power_dirty;           /*!< power budget differs from published */
+    bool power_published;       /*!< power budget has been published */
+    int published_capacity;     /*!< capacity last written to the db (W) */
+    enum power_redundancy published_redundancy; /*!< redundancy in the db */
+    double degraded_flap;       /*!< flap rate that flags a psu degraded */
+    double degraded_fail;       /*!< read failure rate flagging degraded */
+    double degraded_flicker;    /*!< input/output variance flagging it */
+    int n_settling;             /*!< psus in an insertion burst */
+    bool published;             /*!< psu rows committed to the db */
+    char *desc_dir;             /*!< hardware description directory */
+    unsigned int desc_changes;  /*!< DESC_* files changed, not reloaded */
+    long long int desc_reload_at;   /*!< time (ms) to reload them */
+    unsigned int desc_reloads;  /*!< reloads applied */
+    char *desc_work_dir;        /*!< staging directory, or NULL */
+    struct powerd_desc_prune_stats desc_prune; /*!< last devices pruning */
+    long long int desc_parse_usec;  /*!< time of the initial parse (us) */
+    long long int desc_heap_bytes;  /*!< heap used by the initial parse */
     struct locl_subsystem *parent_subsystem; /*!< pointer to parent (if any) */
     struct shash subsystem_psus;  /*!< power supplies in this subsystem */
 };
@@ -165,6 +332,33 @@ struct locl_psu {
     const YamlPsu *yaml_psu;    /*!< psu information */
     enum psustatus status;      /*!< current status result */
     enum psustatus test_status; /*!< status override for test */
+    struct token_bucket event_tb;    /*!< rate limit for transition events */
+    unsigned int events_suppressed;  /*!< transitions not logged (rate) */
+    uint32_t phase_hash;        /*!< hash of name, selects the poll phase */
+    uint32_t desc_hash;         /*!< hash of the status bit operations */
+    int shm_id;                 /*!< shared memory slot, -1 if none */
+    long long int next_poll;    /*!< time (ms) this psu is next due */
+    bool poll_queued;           /*!< waiting in the due queue for budget */
+    struct locl_psu *poll_next; /*!< next psu in the due queue */
+    bool read_pending;          /*!< status read queued, not yet complete */
+    bool read_once;             /*!< a status read has completed */
+    unsigned long long int n_transitions; /*!< status changes seen */
+    long long int last_change;  /*!< wall clock time (ms) of the last one */
+    long long int last_read;    /*!< wall clock time (ms) of the last read */
+    unsigned long long int transitions_published; /*!< in the db */
+    struct powerd_ewma input_stat;  /*!< input fault, while present */
+    struct powerd_ewma output_stat; /*!< output fault, while present */
+    struct powerd_ewma flap_stat;   /*!< status changed on this read */
+    struct powerd_ewma fail_stat;   /*!< read failed */
+    bool degraded;              /*!< health metrics crossed a threshold */
+    const char *degraded_reason;    /*!< metric that raised the flag */
+    bool degraded_published;    /*!< value of degraded in the db */
+    long long int absent_seen;  /*!< time (ms) psu was last read absent */
+    bool settling;              /*!< in a burst of reads after insertion */
+    enum psustatus settle_from; /*!< published status before insertion */
+    int settle_reads;           /*!< consecutive equal reads in the burst */
+    int burst_reads;            /*!< reads so far in the burst */
+    bool hotswap_publish;       /*!< settled, latency recorded on commit */
 };
 
 /************************************************************************//**
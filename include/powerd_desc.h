@@ -0,0 +1,67 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the pruned hardware descriptions of ops-powerd
+ *
+ * The devices file of a subsystem describes every device on it, while
+ * ops-powerd only addresses the few devices that the power description
+ * refers to. config-yaml parses a whole devices file, so the subsystem is
+ * parsed from a staging directory instead, which links to the files of
+ * the hardware description directory but holds a devices file cut down to
+ * the referenced devices and the devices that their access goes through,
+ * such as the muxes in front of them.
+ *
+ * Each instance stages under a root of its own, named after its pid, so
+ * that a standby or another shard never rewrites or removes the files that
+ * an instance is parsing.
+ ***************************************************************************/
+
+#ifndef _POWERD_DESC_H_
+#define _POWERD_DESC_H_
+
+#include <stddef.h>
+#include "sset.h"
+
+/* files of a hardware description directory used by ops-powerd */
+#define DESC_DEVICES_FILE  "devices.yaml"
+#define DESC_POWER_FILE    "psu.yaml"
+#define DESC_THERMAL_FILE  "thermal.yaml"
+
+/************************************************************************//**
+ * STRUCT containing the size of a devices file before and after pruning
+ ***************************************************************************/
+struct powerd_desc_prune_stats {
+    int devices_total;     /*!< devices in the original file */
+    int devices_kept;      /*!< devices in the pruned file */
+    size_t bytes_total;    /*!< size of the original file */
+    size_t bytes_kept;     /*!< size of the pruned file */
+};
+
+void powerd_desc_init(void);
+void powerd_desc_exit(void);
+
+char *powerd_desc_stage(const char *subsystem, const char *dir);
+int powerd_desc_restage(const char *dir, const char *work_dir);
+void powerd_desc_unstage(const char *work_dir);
+int powerd_desc_prune(const char *dir, const char *work_dir,
+                      const struct sset *devices,
+                      struct powerd_desc_prune_stats *stats);
+
+#endif /* _POWERD_DESC_H_ */
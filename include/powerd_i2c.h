@@ -0,0 +1,122 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the ops-powerd i2c request queues
+ *
+ * Hardware accesses are queued per physical bus and executed by one worker
+ * thread per bus, so requests on the same bus are serialised while
+ * different buses are serviced in parallel. Within a bus, requests are
+ * served by priority class (status, then LED, then telemetry, then FRU),
+ * and in submission order within a class.
+ *
+ * Read requests queued together in one class are executed as a batch that
+ * reads each register they address once, and takes the bits of each op
+ * from that read, so the status reads of psus sharing a status register
+ * cost one access instead of one per psu and bit.
+ *
+ * Completed requests are handed back to the main thread, which runs their
+ * callbacks from powerd_i2c_run(). Callbacks therefore never race with the
+ * rest of the daemon.
+ ***************************************************************************/
+
+#ifndef _POWERD_I2C_H_
+#define _POWERD_I2C_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "dynamic-string.h"
+#include "config-yaml.h"
+
+/************************************************************************//**
+ * ENUM containing the priority classes of i2c requests, highest first
+ ***************************************************************************/
+enum powerd_i2c_prio {
+    I2C_PRIO_STATUS,     /*!< psu status reads */
+    I2C_PRIO_LED,        /*!< status LED writes */
+    I2C_PRIO_TELEMETRY,  /*!< telemetry reads */
+    I2C_PRIO_FRU,        /*!< FRU EEPROM reads */
+    I2C_PRIO_MAX
+};
+
+#define I2C_REQ_MAX_OPS  4  /*!< bit operations in one request */
+
+/* result of an operation on a device that did not acknowledge its
+   address, as an absent psu does */
+#define I2C_RC_NO_DEVICE  (-ENXIO)
+
+struct powerd_i2c_req;
+struct powerd_i2c_bus;
+
+/* called in the main thread when a request has been executed */
+typedef void powerd_i2c_cb(struct powerd_i2c_req *);
+
+/************************************************************************//**
+ * STRUCT containing one queued hardware request: a short sequence of bit
+ * operations on one subsystem, all reads or all writes
+ ***************************************************************************/
+struct powerd_i2c_req {
+    struct powerd_i2c_req *next;   /*!< queue linkage */
+    struct powerd_i2c_bus *bus;    /*!< bus the request is queued on */
+    enum powerd_i2c_prio prio;     /*!< priority class */
+    bool write;                    /*!< write values[] instead of reading */
+    char *subsystem;               /*!< subsystem name */
+    char *owner;                   /*!< psu or subsystem the result is for */
+    size_t n_ops;                  /*!< number of valid entries in ops[] */
+    const i2c_bit_op *ops[I2C_REQ_MAX_OPS]; /*!< operations, in order */
+    uint32_t values[I2C_REQ_MAX_OPS];       /*!< values read or to write */
+    int rcs[I2C_REQ_MAX_OPS];               /*!< result of each operation */
+    uint16_t op_ids[I2C_REQ_MAX_OPS];       /*!< trace op ids, if recording */
+    long long int queued;          /*!< time (us) the request was queued */
+    long long int started;         /*!< time (us) execution started */
+    long long int done;            /*!< time (us) execution finished */
+    powerd_i2c_cb *cb;             /*!< completion callback, may be NULL */
+};
+
+void powerd_i2c_init(YamlConfigHandle handle);
+void powerd_i2c_set_combine(bool combine);
+void powerd_i2c_exit(void);
+
+struct powerd_i2c_req *powerd_i2c_req_create(enum powerd_i2c_prio prio,
+                                             const char *subsystem,
+                                             const char *owner,
+                                             powerd_i2c_cb *cb);
+void powerd_i2c_req_add_read(struct powerd_i2c_req *req,
+                             const i2c_bit_op *op);
+void powerd_i2c_req_add_write(struct powerd_i2c_req *req,
+                              const i2c_bit_op *op, uint32_t value);
+void powerd_i2c_req_destroy(struct powerd_i2c_req *req);
+
+void powerd_i2c_submit(struct powerd_i2c_req *req);
+bool powerd_i2c_idle(const char *subsystem);
+
+bool powerd_i2c_charge(const char *subsystem, const i2c_bit_op *op,
+                       long long int budget_usec);
+void powerd_i2c_budget_reset(void);
+
+void powerd_i2c_desc_lock(void);
+void powerd_i2c_desc_unlock(void);
+
+void powerd_i2c_run(void);
+void powerd_i2c_wait(void);
+void powerd_i2c_dump(struct ds *ds);
+void powerd_i2c_metrics(struct ds *ds, struct ds *labels);
+
+#endif /* _POWERD_I2C_H_ */
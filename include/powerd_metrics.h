@@ -0,0 +1,67 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the ops-powerd OpenMetrics endpoint
+ *
+ * The metrics page is served over HTTP/1.0 on a local unix socket, one
+ * page per connection, and is rendered by a callback of the daemon into a
+ * buffer that is kept between scrapes. Rendering only reads daemon state,
+ * never the IDL. Connections are serviced from the main loop without
+ * blocking it. The socket is only open while the daemon is active, since
+ * creating it replaces a socket left at the same path.
+ ***************************************************************************/
+
+#ifndef _POWERD_METRICS_H_
+#define _POWERD_METRICS_H_
+
+#include "dynamic-string.h"
+
+#define METRICS_BUCKETS  12  /*!< histogram buckets, the last is +Inf */
+
+/************************************************************************//**
+ * STRUCT containing a latency histogram with fixed buckets from 100 us to
+ * 250 ms
+ ***************************************************************************/
+struct powerd_histogram {
+    unsigned long long int count;    /*!< samples */
+    long long int sum;               /*!< sum of the samples (us) */
+    unsigned long long int buckets[METRICS_BUCKETS]; /*!< per bucket */
+};
+
+/* renders the metrics page (without the trailing "# EOF") */
+typedef void powerd_metrics_render_cb(struct ds *);
+
+void powerd_histogram_add(struct powerd_histogram *hist, long long int usec);
+
+void powerd_metrics_put_label(struct ds *ds, const char *name,
+                              const char *value);
+void powerd_metrics_put_histogram(struct ds *ds, const char *name,
+                                  const char *labels,
+                                  const struct powerd_histogram *hist);
+
+void powerd_metrics_init(const char *path, powerd_metrics_render_cb *cb);
+void powerd_metrics_exit(void);
+void powerd_metrics_open(void);
+void powerd_metrics_close(void);
+const char *powerd_metrics_render(void);
+void powerd_metrics_run(void);
+void powerd_metrics_wait(void);
+
+#endif /* _POWERD_METRICS_H_ */
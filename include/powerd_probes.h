@@ -0,0 +1,75 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Static tracepoints of ops-powerd
+ *
+ * When built with <sys/sdt.h>, each POWERD_PROBE*() is a USDT probe of
+ * provider "ops_powerd", which compiles to a single nop until a tracer
+ * such as perf or bpftrace attaches to it. Without <sys/sdt.h> the probes
+ * compile to nothing. Probe arguments must be free of side effects.
+ *
+ * Probes (arguments in order):
+ *   cycle_start, cycle_end
+ *   reconfigure           idl seqno
+ *   i2c_op_start          subsystem, device, register, write
+ *   i2c_op_done           subsystem, device, register, write, value, rc
+ *   i2c_req_done          owner, priority, queueing us, execution us
+ *   psu_status            psu, old status, new status
+ *   txn_create            site
+ *   txn_commit            site, ovsdb_idl_txn_status
+ *
+ * For example, the latency of every register access:
+ *   bpftrace -e 'usdt:ops-powerd:ops_powerd:i2c_op_start
+ *                  { @s[tid] = nsecs; }
+ *                usdt:ops-powerd:ops_powerd:i2c_op_done /@s[tid]/
+ *                  { @us = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+ ***************************************************************************/
+
+#ifndef _POWERD_PROBES_H_
+#define _POWERD_PROBES_H_
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define POWERD_PROBE(name) \
+    DTRACE_PROBE(ops_powerd, name)
+#define POWERD_PROBE1(name, a1) \
+    DTRACE_PROBE1(ops_powerd, name, a1)
+#define POWERD_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2(ops_powerd, name, a1, a2)
+#define POWERD_PROBE3(name, a1, a2, a3) \
+    DTRACE_PROBE3(ops_powerd, name, a1, a2, a3)
+#define POWERD_PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(ops_powerd, name, a1, a2, a3, a4)
+#define POWERD_PROBE6(name, a1, a2, a3, a4, a5, a6) \
+    DTRACE_PROBE6(ops_powerd, name, a1, a2, a3, a4, a5, a6)
+
+#else /* !HAVE_SYS_SDT_H */
+
+#define POWERD_PROBE(name)
+#define POWERD_PROBE1(name, a1)
+#define POWERD_PROBE2(name, a1, a2)
+#define POWERD_PROBE3(name, a1, a2, a3)
+#define POWERD_PROBE4(name, a1, a2, a3, a4)
+#define POWERD_PROBE6(name, a1, a2, a3, a4, a5, a6)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* _POWERD_PROBES_H_ */
@@ -0,0 +1,57 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the ops-powerd main loop profiler and stall watchdog
+ *
+ * The main loop marks the start of each of its phases. The time spent in
+ * every phase of the last iterations is kept for percentile reports, and
+ * a watchdog thread reports, and optionally aborts on, an iteration that
+ * runs past a deadline without returning to poll_block().
+ ***************************************************************************/
+
+#ifndef _POWERD_PROFILE_H_
+#define _POWERD_PROFILE_H_
+
+#include <stdbool.h>
+#include "dynamic-string.h"
+
+/************************************************************************//**
+ * ENUM containing the phases of a main loop iteration, in order
+ ***************************************************************************/
+enum powerd_phase {
+    PHASE_IDL_RUN,       /*!< ovsdb_idl_run() */
+    PHASE_I2C,           /*!< completed hardware requests, trace */
+    PHASE_METRICS,       /*!< metrics scrapes */
+    PHASE_RECONFIGURE,   /*!< powerd_reconfigure() */
+    PHASE_RUN,           /*!< powerd_run__(), poll and publish */
+    PHASE_UNIXCTL,       /*!< unixctl_server_run() */
+    PHASE_WAIT,          /*!< wait functions, before poll_block() */
+    PHASE_MAX
+};
+
+void powerd_profile_init(long long int deadline, bool abort_on_stall);
+void powerd_profile_exit(void);
+
+void powerd_profile_phase(enum powerd_phase phase);
+void powerd_profile_idle(void);
+
+void powerd_profile_dump(struct ds *ds);
+
+#endif /* _POWERD_PROFILE_H_ */
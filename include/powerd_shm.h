@@ -0,0 +1,142 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the ops-powerd shared memory psu snapshot
+ *
+ * ops-powerd publishes the state of its psus in a POSIX shared memory
+ * segment, for local daemons that only need to know the psu status and
+ * would otherwise keep a replica of the Power_supply table. The segment
+ * has the fixed layout below and is written by the main thread of
+ * ops-powerd only, under a sequence lock: the sequence number is odd while
+ * the segment is being written, and a reader that saw the same even
+ * sequence number before and after reading has read a consistent state.
+ * Once a reader has mapped the segment, reading it takes no system call.
+ *
+ * A psu keeps its slot, its id, for as long as ops-powerd runs and the psu
+ * is described; the generation number changes whenever a slot is taken or
+ * freed, so a reader that caches ids by name looks them up again then.
+ *
+ * This header has no dependencies beyond the C library, and the reader
+ * functions are in libpowerd_shm.
+ ***************************************************************************/
+
+#ifndef _POWERD_SHM_H_
+#define _POWERD_SHM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* name of the segment; with --shard=ID/COUNT, POWERD_SHM_NAME ".shardID" */
+#define POWERD_SHM_NAME     "/ops-powerd.psu"
+
+#define POWERD_SHM_MAGIC    0x50535553  /*!< "PSUS" */
+#define POWERD_SHM_VERSION  1           /*!< layout version */
+
+#define POWERD_SHM_MAX_PSUS  64   /*!< psu slots in the segment */
+#define POWERD_SHM_NAME_LEN  32   /*!< psu name size, with the NUL */
+
+/************************************************************************//**
+ * ENUM containing the psu status values of the segment
+ ***************************************************************************/
+enum powerd_shm_status {
+    POWERD_SHM_UNKNOWN = 0,       /*!< not read yet, or unmanaged */
+    POWERD_SHM_OK = 1,            /*!< present and ok */
+    POWERD_SHM_FAULT_INPUT = 2,   /*!< input fault */
+    POWERD_SHM_FAULT_OUTPUT = 3,  /*!< output fault */
+    POWERD_SHM_FAULT_ABSENT = 4   /*!< not present */
+};
+
+#define POWERD_SHM_PSU_USED      0x1  /*!< the slot holds a psu */
+#define POWERD_SHM_PSU_DEGRADED  0x2  /*!< health metrics flag the psu */
+
+/************************************************************************//**
+ * STRUCT containing the state of one psu
+ ***************************************************************************/
+struct powerd_shm_psu {
+    char name[POWERD_SHM_NAME_LEN];  /*!< Power_supply name */
+    uint32_t status;                 /*!< enum powerd_shm_status */
+    uint32_t flags;                  /*!< POWERD_SHM_PSU_* */
+    uint64_t transitions;            /*!< status transitions seen */
+    int64_t last_change;             /*!< wall clock (ms) of the last one */
+    int64_t last_read;               /*!< wall clock (ms) of the last read */
+    double flap_rate;                /*!< share of reads changing status */
+    double fail_rate;                /*!< share of reads failing */
+};
+
+/************************************************************************//**
+ * STRUCT containing the whole segment
+ ***************************************************************************/
+struct powerd_shm_segment {
+    uint32_t magic;                  /*!< POWERD_SHM_MAGIC */
+    uint32_t version;                /*!< POWERD_SHM_VERSION */
+    uint32_t size;                   /*!< sizeof(struct powerd_shm_segment) */
+    uint32_t psu_size;               /*!< sizeof(struct powerd_shm_psu) */
+    uint64_t seq;                    /*!< sequence lock, odd while written */
+    uint64_t generation;             /*!< changes when slots change */
+    int32_t writer_pid;              /*!< pid of the writer, 0 if it exited */
+    uint32_t n_psus;                 /*!< slots in use below this index */
+    int64_t updated;                 /*!< wall clock (ms) of the last write */
+    struct powerd_shm_psu psus[POWERD_SHM_MAX_PSUS]; /*!< indexed by id */
+};
+
+/* a mapped segment */
+struct powerd_shm_reader {
+    const struct powerd_shm_segment *seg;
+    size_t size;
+};
+
+int powerd_shm_reader_open(struct powerd_shm_reader *reader,
+                           const char *name);
+void powerd_shm_reader_close(struct powerd_shm_reader *reader);
+
+int powerd_shm_read(const struct powerd_shm_reader *reader,
+                    struct powerd_shm_segment *snapshot);
+int powerd_shm_read_psu(const struct powerd_shm_reader *reader, int id,
+                        struct powerd_shm_psu *psu, uint64_t *generation);
+int powerd_shm_find(const struct powerd_shm_reader *reader, const char *name,
+                    uint64_t *generation);
+
+/* Sequence lock helpers, shared by the writer and the readers. A reader
+ * calls powerd_shm_read_begin(), copies what it needs, and tries again if
+ * powerd_shm_read_retry() returns true, which it does while the segment
+ * is being written. */
+static inline uint64_t
+powerd_shm_read_begin(const struct powerd_shm_segment *seg)
+{
+    return __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+}
+
+static inline bool
+powerd_shm_read_retry(const struct powerd_shm_segment *seg, uint64_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || __atomic_load_n(&seg->seq, __ATOMIC_RELAXED) != seq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _POWERD_SHM_H_ */
@@ -0,0 +1,48 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for the writer of the ops-powerd shared memory psu snapshot
+ *
+ * The slots are kept in a private copy of the segment until the instance
+ * becomes active and maps the shared segment, so that psus discovered by
+ * a standby keep their ids across a takeover. The layout is described in
+ * powerd_shm.h.
+ ***************************************************************************/
+
+#ifndef _POWERD_SHM_WRITER_H_
+#define _POWERD_SHM_WRITER_H_
+
+#include <stdbool.h>
+#include "powerd_shm.h"
+
+void powerd_shm_writer_init(void);
+void powerd_shm_writer_exit(void);
+
+int powerd_shm_writer_open(const char *name);
+void powerd_shm_writer_close(void);
+bool powerd_shm_writer_is_open(void);
+
+int powerd_shm_alloc(const char *name);
+void powerd_shm_free(int id);
+
+struct powerd_shm_psu *powerd_shm_write_begin(void);
+void powerd_shm_write_end(void);
+
+#endif /* _POWERD_SHM_WRITER_H_ */
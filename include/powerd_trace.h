@@ -0,0 +1,105 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for recording and replaying ops-powerd register traces
+ *
+ * When recording, every register access made by the i2c workers is
+ * stored, with its time, duration, value and result, in a lock-free ring
+ * per bus. The main loop drains the rings into a binary trace file. An
+ * access that finds its ring full is dropped from the trace and counted,
+ * so recording never stalls a worker.
+ *
+ * When replaying, the workers do not touch the hardware: each access is
+ * answered with the next recorded result for the same subsystem, device,
+ * register, mask and direction. At real time the recorded timing and
+ * duration of each access are reproduced; otherwise results are returned
+ * immediately.
+ *
+ * Trace file layout, in host byte order: a struct powerd_trace_header,
+ * then struct powerd_trace_rec records. A TRACE_REC_DEFINE record
+ * introduces an op id and is followed by "subsystem\0device\0", its
+ * length given in the latency field.
+ ***************************************************************************/
+
+#ifndef _POWERD_TRACE_H_
+#define _POWERD_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "dynamic-string.h"
+#include "config-yaml.h"
+
+#define TRACE_MAGIC    0x52545750  /*!< "PWTR" */
+#define TRACE_VERSION  1
+
+/************************************************************************//**
+ * ENUM containing the record types of a trace file
+ ***************************************************************************/
+enum powerd_trace_type {
+    TRACE_REC_DEFINE = 1,  /*!< op id definition */
+    TRACE_REC_READ = 2,    /*!< register read */
+    TRACE_REC_WRITE = 3    /*!< register write */
+};
+
+/************************************************************************//**
+ * STRUCT containing the header of a trace file
+ ***************************************************************************/
+struct powerd_trace_header {
+    uint32_t magic;        /*!< TRACE_MAGIC */
+    uint32_t version;      /*!< TRACE_VERSION */
+    uint64_t start;        /*!< time (us) recording started */
+};
+
+/************************************************************************//**
+ * STRUCT containing one trace record, 24 bytes
+ ***************************************************************************/
+struct powerd_trace_rec {
+    uint64_t time;         /*!< time (us) the access started */
+    uint32_t value;        /*!< value read or written; mask for DEFINE */
+    int32_t rc;            /*!< result; register address for DEFINE */
+    uint16_t op;           /*!< op id */
+    uint8_t type;          /*!< enum powerd_trace_type */
+    uint8_t pad;
+    uint32_t latency;      /*!< duration (us); name length for DEFINE */
+};
+
+struct powerd_trace_ring;
+
+int powerd_trace_record_open(const char *file);
+int powerd_trace_replay_open(const char *file, bool realtime);
+void powerd_trace_close(void);
+
+bool powerd_trace_recording(void);
+bool powerd_trace_replaying(void);
+
+/* main thread */
+struct powerd_trace_ring *powerd_trace_ring_create(void);
+uint16_t powerd_trace_op_id(const char *subsystem, const i2c_bit_op *op);
+void powerd_trace_run(void);
+void powerd_trace_dump(struct ds *ds);
+
+/* i2c worker threads */
+void powerd_trace_put(struct powerd_trace_ring *ring, uint16_t op, bool write,
+                      uint32_t value, int rc, long long int start,
+                      long long int latency);
+int powerd_trace_replay_op(const char *subsystem, const i2c_bit_op *op,
+                           bool write, uint32_t *value);
+
+#endif /* _POWERD_TRACE_H_ */
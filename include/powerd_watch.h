@@ -0,0 +1,47 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Header for watching the hardware description directories of ops-powerd
+ *
+ * Each subsystem's hardware description directory is watched with
+ * inotify from the main loop. A file that is written, created, moved in
+ * or out, or deleted is reported to a callback of the daemon with the
+ * subsystem and the file name; debouncing is left to the daemon. A
+ * directory that goes away is watched again when the daemon next adds it.
+ ***************************************************************************/
+
+#ifndef _POWERD_WATCH_H_
+#define _POWERD_WATCH_H_
+
+#include <stdbool.h>
+
+/* called from powerd_watch_run() for each changed file */
+typedef void powerd_watch_cb(const char *subsystem, const char *file);
+
+void powerd_watch_init(powerd_watch_cb *cb);
+void powerd_watch_exit(void);
+
+bool powerd_watch_add(const char *subsystem, const char *dir);
+void powerd_watch_remove(const char *subsystem);
+
+void powerd_watch_run(void);
+void powerd_watch_wait(void);
+
+#endif /* _POWERD_WATCH_H_ */
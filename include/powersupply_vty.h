@@ -28,8 +28,13 @@
 #define SYS_STR         "System information\n"
 #endif
 #define PSU_STR         "Power supply information\n"
+#ifndef JSON_STR
+#define JSON_STR        "Output in JSON format\n"
+#endif
 
 int cli_system_get_psu();
+int cli_system_watch_psu(void);
+int cli_system_get_psu_json(const char *subsystem);
 
 void cli_pre_init(void);
 void cli_post_init(void);
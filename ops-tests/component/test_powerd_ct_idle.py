@@ -0,0 +1,91 @@
+# -*- coding: utf-8 -*-
+
+# (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+#
+# GNU Zebra is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2, or (at your option) any
+# later version.
+#
+# GNU Zebra is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU Zebra; see the file COPYING.  If not, write to the Free
+# Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+# 02111-1307, USA.
+
+import time
+
+TOPOLOGY = """
+# +-------+
+# |  sw1  |
+# +-------+
+
+# Nodes
+[type=openswitch name="Switch 1"] sw1
+"""
+
+# a few default polling periods
+IDLE_TIME = 20
+
+
+def get_subsystem_uuid(sw1):
+    output = sw1('list subsystem', shell='vsctl')
+    lines = output.split('\n')
+    for line in lines:
+        if '_uuid' in line:
+            _id = line.split(':')
+            return _id[1].strip()
+    return None
+
+
+def get_txn_commits(sw1):
+    # number of transactions committed by ops-powerd so far
+    output = sw1('ovs-appctl -t ops-powerd coverage/show', shell='bash')
+    lines = output.split('\n')
+    for line in lines:
+        if 'powerd_txn_commit' in line and 'total:' in line:
+            return int(line.split('total:')[1].strip())
+    # counters that were never hit are not listed
+    return 0
+
+
+def get_psu_status(sw1, name):
+    output = sw1('ovs-vsctl --bare -- --columns=status find Power_supply '
+                 'name={}'.format(name), shell='bash')
+    return output.strip()
+
+
+def create_orphan_psu(sw1, uuid):
+    # a row that ops-powerd owns but does not manage, as left behind by a
+    # subsystem whose hardware description no longer lists the psu
+    # the row is appended, so the rows of ops-powerd stay referenced
+    sw1('ovs-vsctl -- add Subsystem {} power_supplies @psu1 '
+        '-- --id=@psu1 create '
+        ' Power_supply name=Psu_orphan status=ok '
+        ' external_ids:powerd_owner=ops-powerd'.format(uuid),
+        shell='bash')
+
+
+def test_powerd_ct_idle(topology, step):
+    sw1 = topology.get("sw1")
+    assert sw1 is not None
+
+    uuid = get_subsystem_uuid(sw1)
+    assert uuid is not None
+
+    step("Creating an orphaned power supply row")
+    create_orphan_psu(sw1, uuid)
+    time.sleep(5)
+
+    step("Verifying the orphaned row was marked unknown")
+    assert get_psu_status(sw1, 'Psu_orphan') == 'unknown'
+
+    step("Verifying an idle ops-powerd commits no transactions")
+    before = get_txn_commits(sw1)
+    time.sleep(IDLE_TIME)
+    after = get_txn_commits(sw1)
+    assert after == before
@@ -18,6 +18,7 @@
 # 02111-1307, USA.
 
 from pytest import mark
+import json
 import time
 
 TOPOLOGY = """
@@ -108,6 +109,103 @@ def show_system_psu(sw1):  # noqa
                 break
     assert system_psu_config_present
 
+
+# status of each row created for the JSON test, and its table text
+JSON_PSUS = {
+    'Psu_json0': ('ok', 'OK'),
+    'Psu_json1': ('fault_input', 'Input Fault'),
+    'Psu_json2': ('fault_output', 'Output Fault'),
+    'Psu_json3': ('fault_absent', 'Absent'),
+    'Psu_json4': ('unknown', 'Unknown'),
+}
+
+
+def get_subsystem(sw1):
+    output = sw1('ovs-vsctl --bare -- --columns=_uuid,name list Subsystem',
+                 shell='bash')
+    fields = output.split()
+    return fields[0], fields[1]
+
+
+def add_json_psus(sw1, uuid):
+    # rows are appended to those of the subsystem, and have no
+    # powerd_owner, so ops-powerd leaves them as they are
+    for name, (status, _) in JSON_PSUS.items():
+        sw1('ovs-vsctl -- add Subsystem {} power_supplies @psu1 '
+            '-- --id=@psu1 create Power_supply name={} status={} '
+            'external_ids:test=json'.format(uuid, name, status),
+            shell='bash')
+
+
+def remove_json_psus(sw1, uuid):
+    for name in JSON_PSUS:
+        row = sw1('ovs-vsctl --bare -- --columns=_uuid find Power_supply '
+                  'name={}'.format(name), shell='bash').strip()
+        if row:
+            sw1('ovs-vsctl -- remove Subsystem {} power_supplies '
+                '{}'.format(uuid, row), shell='bash')
+
+
+def get_db_psus(sw1):
+    # name -> (status, external_ids) of every Power_supply row
+    output = sw1('ovs-vsctl --format=json -- '
+                 '--columns=name,status,external_ids list Power_supply',
+                 shell='bash')
+    table = json.loads(output.strip())
+    rows = {}
+    for name, status, external_ids in table['data']:
+        rows[name] = (status, dict(external_ids[1]))
+    return rows
+
+
+def check_psu_json(doc, db_psus):
+    total = {'total': 0, 'present': 0}
+    for subsystem in doc['subsystems']:
+        for psu in subsystem['power_supplies']:
+            status, external_ids = db_psus[psu['name']]
+            assert psu['status'] == status
+            assert psu['external_ids'] == external_ids
+            if psu['name'] in JSON_PSUS:
+                assert psu['status_text'] == JSON_PSUS[psu['name']][1]
+            total['total'] += 1
+            if status != 'fault_absent':
+                total['present'] += 1
+            total[status] = total.get(status, 0) + 1
+        assert subsystem['summary']['total'] == \
+            len(subsystem['power_supplies'])
+    for key, count in total.items():
+        assert doc['summary'][key] == count
+
+
+def test_powerd_ct_powersupply_json(topology, step):
+    sw1 = topology.get("sw1")
+    assert sw1 is not None
+
+    uuid, name = get_subsystem(sw1)
+    step("Adding power supply rows in every status")
+    add_json_psus(sw1, uuid)
+    try:
+        db_psus = get_db_psus(sw1)
+
+        step('Test to verify \'show system power-supply json\' command')
+        doc = json.loads(sw1('show system power-supply json').strip())
+        names = [psu['name'] for subsystem in doc['subsystems']
+                 for psu in subsystem['power_supplies']]
+        for psu in JSON_PSUS:
+            assert psu in names
+        check_psu_json(doc, db_psus)
+
+        step('Test to verify \'show system power-supply subsystem NAME '
+             'json\' command')
+        doc = json.loads(sw1('show system power-supply subsystem {} '
+                             'json'.format(name)).strip())
+        assert [subsystem['name'] for subsystem in doc['subsystems']] == \
+            [name]
+        check_psu_json(doc, db_psus)
+    finally:
+        remove_json_psus(sw1, uuid)
+
+
 @mark.skipif(True, reason="Skipped test case temporarily to avoid failures"
                           " This script needs some refactoring")
 def test_powerd_ct_powersupply(topology, step):
@@ -23,6 +23,8 @@
  * Purpose:  To add power supply CLI configuration and display commands.
  */
 
+#include <signal.h>
+#include <time.h>
 #include "vtysh/command.h"
 #include "vtysh/vtysh.h"
 #include "vtysh/vtysh_user.h"
@@ -30,7 +32,12 @@
 #include "vswitch-idl.h"
 #include "ovsdb-idl.h"
 #include "smap.h"
+#include "shash.h"
 #include "memory.h"
+#include "dirs.h"
+#include "latch.h"
+#include "poll-loop.h"
+#include "uuid.h"
 #include "openvswitch/vlog.h"
 #include "openswitch-idl.h"
 #include "vtysh/utils/system_vtysh_utils.h"
@@ -39,6 +46,15 @@ VLOG_DEFINE_THIS_MODULE(vtysh_powersupply_cli);
 
 extern struct ovsdb_idl *idl;
 
+/* set by SIGINT to stop "show system power-supply watch" */
+static struct latch watch_latch;
+
+/* last status reported for a power supply row, keyed by row uuid */
+struct watch_psu_entry {
+    char *name;
+    char *status;
+};
+
 /*
  * Function        : compare_psu
  * Resposibility    : Power Supply sort function for qsort
@@ -146,6 +162,463 @@ cli_system_get_psu()
     return CMD_SUCCESS;
 }
 
+/* power supply status values, in the order of the JSON summary counts */
+static const char *json_psu_status[] = {
+    OVSREC_POWER_SUPPLY_STATUS_OK,
+    OVSREC_POWER_SUPPLY_STATUS_FAULT_INPUT,
+    OVSREC_POWER_SUPPLY_STATUS_FAULT_OUTPUT,
+    OVSREC_POWER_SUPPLY_STATUS_FAULT_ABSENT,
+    OVSREC_POWER_SUPPLY_STATUS_UNKNOWN
+};
+#define JSON_PSU_STATUS_MAX (sizeof json_psu_status / sizeof json_psu_status[0])
+
+/* power supply counts of one subsystem, or of the whole system */
+struct json_psu_summary {
+    int total;
+    int present;
+    int status[JSON_PSU_STATUS_MAX];
+};
+
+/*
+ * Function        : json_put_string
+ * Resposibility   : Write a string to the vty as a JSON string. Runs of
+ *                   characters that need no escaping are written straight
+ *                   from the string, so nothing is copied.
+ * Parameters
+ *      s       : String to write, or NULL for a JSON null
+ */
+static void
+json_put_string(const char *s)
+{
+    const char *run;
+
+    if (!s) {
+        vty_out(vty, "null");
+        return;
+    }
+
+    vty_out(vty, "\"");
+    for (run = s; *s; s++) {
+        unsigned char c = *s;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        if (s > run)
+            vty_out(vty, "%.*s", (int)(s - run), run);
+        switch (c) {
+        case '"':
+            vty_out(vty, "\\\"");
+            break;
+        case '\\':
+            vty_out(vty, "\\\\");
+            break;
+        case '\n':
+            vty_out(vty, "\\n");
+            break;
+        case '\r':
+            vty_out(vty, "\\r");
+            break;
+        case '\t':
+            vty_out(vty, "\\t");
+            break;
+        default:
+            vty_out(vty, "\\u%04x", c);
+            break;
+        }
+        run = s + 1;
+    }
+    if (s > run)
+        vty_out(vty, "%.*s", (int)(s - run), run);
+    vty_out(vty, "\"");
+}
+
+/*
+ * Function        : json_put_smap
+ * Resposibility   : Write a string map column to the vty as a JSON object
+ * Parameters
+ *      smap    : Column to write
+ */
+static void
+json_put_smap(const struct smap *smap)
+{
+    const struct smap_node *node;
+    bool first = true;
+
+    vty_out(vty, "{");
+    SMAP_FOR_EACH (node, smap)
+    {
+        vty_out(vty, first ? "" : ",");
+        json_put_string(node->key);
+        vty_out(vty, ":");
+        json_put_string(node->value);
+        first = false;
+    }
+    vty_out(vty, "}");
+}
+
+/*
+ * Function        : json_put_summary
+ * Resposibility   : Write power supply counts to the vty as a JSON object
+ * Parameters
+ *      summary : Counts to write
+ */
+static void
+json_put_summary(const struct json_psu_summary *summary)
+{
+    size_t i;
+
+    vty_out(vty, "{\"total\":%d,\"present\":%d", summary->total,
+            summary->present);
+    for (i = 0; i < JSON_PSU_STATUS_MAX; i++)
+        vty_out(vty, ",\"%s\":%d", json_psu_status[i], summary->status[i]);
+    vty_out(vty, "}");
+}
+
+/*
+ * Function        : json_count_psu
+ * Resposibility   : Add a power supply to the counts of its subsystem
+ * Parameters
+ *      summary : Counts to update
+ *      status  : Status of the power supply
+ */
+static void
+json_count_psu(struct json_psu_summary *summary, const char *status)
+{
+    size_t i;
+
+    summary->total++;
+    if (!status)
+        return;
+    if (0 != strcmp(status, OVSREC_POWER_SUPPLY_STATUS_FAULT_ABSENT))
+        summary->present++;
+    for (i = 0; i < JSON_PSU_STATUS_MAX; i++)
+    {
+        if (0 == strcmp(status, json_psu_status[i]))
+        {
+            summary->status[i]++;
+            break;
+        }
+    }
+}
+
+/*
+ * Function        : compare_psu_ptr
+ * Resposibility   : Power Supply sort function for qsort, on an array of
+ *                   row pointers
+ * Parameters
+ *   a   : Pointer to 1st element in the array
+ *   b   : Pointer to next element in the array
+ * Return      : comparative difference between names.
+ */
+static int
+compare_psu_ptr(const void *a, const void *b)
+{
+    const struct ovsrec_power_supply *const *s1 = a;
+    const struct ovsrec_power_supply *const *s2 = b;
+
+    return (strcmp((*s1)->name, (*s2)->name));
+}
+
+/*
+ * Function        : json_put_subsystem
+ * Resposibility   : Write a subsystem and its power supplies to the vty as
+ *                   a JSON object, and add its counts to the system counts
+ * Parameters
+ *      pSys    : Subsystem row
+ *      total   : System counts to update
+ * Return      : CMD_SUCCESS, or CMD_OVSDB_FAILURE if out of memory
+ */
+static int
+json_put_subsystem(const struct ovsrec_subsystem *pSys,
+                   struct json_psu_summary *total)
+{
+    const struct ovsrec_power_supply **pPSUs = NULL;
+    struct json_psu_summary summary;
+    size_t n = pSys->n_power_supplies;
+    size_t i, j;
+
+    /* only the row pointers are sorted, the rows are used in place */
+    if (n > 0)
+    {
+        pPSUs = malloc(n * sizeof *pPSUs);
+        if (!pPSUs)
+            return CMD_OVSDB_FAILURE;
+        memcpy(pPSUs, pSys->power_supplies, n * sizeof *pPSUs);
+        qsort(pPSUs, n, sizeof *pPSUs, compare_psu_ptr);
+    }
+
+    memset(&summary, 0, sizeof summary);
+    vty_out(vty, "{\"name\":");
+    json_put_string(pSys->name);
+    vty_out(vty, ",\"power_supplies\":[");
+    for (i = 0; i < n; i++)
+    {
+        const struct ovsrec_power_supply *pPSU = pPSUs[i];
+
+        vty_out(vty, "%s{\"name\":", i ? "," : "");
+        json_put_string(pPSU->name);
+        vty_out(vty, ",\"status\":");
+        json_put_string(pPSU->status);
+        vty_out(vty, ",\"status_text\":");
+        json_put_string(format_psu_string(pPSU->status));
+        vty_out(vty, ",\"other_config\":");
+        json_put_smap(&pPSU->other_config);
+        vty_out(vty, ",\"external_ids\":");
+        json_put_smap(&pPSU->external_ids);
+        vty_out(vty, "}");
+
+        json_count_psu(&summary, pPSU->status);
+    }
+    vty_out(vty, "],\"summary\":");
+    json_put_summary(&summary);
+    vty_out(vty, ",\"external_ids\":");
+    json_put_smap(&pSys->external_ids);
+    vty_out(vty, "}");
+
+    total->total += summary.total;
+    total->present += summary.present;
+    for (j = 0; j < JSON_PSU_STATUS_MAX; j++)
+        total->status[j] += summary.status[j];
+
+    free(pPSUs);
+    return CMD_SUCCESS;
+}
+
+/*
+ * Function        : cli_system_get_psu_json
+ * Resposibility   : Print the power supplies of all subsystems, or of one,
+ *                   as one JSON document on a single line. The document is
+ *                   written to the vty as the IDL rows are visited, for
+ *                   tools that poll the power supply state.
+ * Parameters
+ *      subsystem : Name of the subsystem to print, or NULL for all
+ * Return      : CMD_SUCCESS, CMD_WARNING if the subsystem does not exist,
+ *               or CMD_OVSDB_FAILURE
+ */
+int
+cli_system_get_psu_json(const char *subsystem)
+{
+    const struct ovsrec_subsystem *pSys = NULL;
+    struct json_psu_summary total;
+    bool first = true;
+    int rc = CMD_SUCCESS;
+
+    if (subsystem)
+    {
+        OVSREC_SUBSYSTEM_FOR_EACH (pSys, idl)
+        {
+            if (pSys->name && 0 == strcmp(pSys->name, subsystem))
+                break;
+        }
+        if (!pSys)
+        {
+            vty_out(vty, "%% Subsystem %s not found%s", subsystem,
+                    VTY_NEWLINE);
+            return CMD_WARNING;
+        }
+    }
+
+    memset(&total, 0, sizeof total);
+    vty_out(vty, "{\"subsystems\":[");
+    OVSREC_SUBSYSTEM_FOR_EACH (pSys, idl)
+    {
+        if (subsystem && (!pSys->name || 0 != strcmp(pSys->name, subsystem)))
+            continue;
+
+        vty_out(vty, first ? "" : ",");
+        rc = json_put_subsystem(pSys, &total);
+        if (rc != CMD_SUCCESS)
+            break;
+        first = false;
+    }
+    vty_out(vty, "],\"summary\":");
+    json_put_summary(&total);
+    vty_out(vty, "}%s", VTY_NEWLINE);
+
+    return rc;
+}
+
+/*
+ * Function        : watch_psu_sigint
+ * Resposibility   : SIGINT handler used while watching power supplies
+ * Parameters
+ *      sig     : Signal number (unused)
+ */
+static void
+watch_psu_sigint(int sig)
+{
+    latch_set(&watch_latch);
+}
+
+/*
+ * Function        : watch_psu_report
+ * Resposibility   : Compare a tracked Power_supply row against the last
+ *                   status seen for it and print a line if it changed
+ * Parameters
+ *      last    : Dictionary of struct watch_psu_entry keyed by row uuid
+ *      pPSU    : Tracked row (inserted, modified or deleted)
+ *      print   : false while loading the initial snapshot
+ */
+static void
+watch_psu_report(struct shash *last, const struct ovsrec_power_supply *pPSU,
+                 bool print)
+{
+    struct watch_psu_entry *entry;
+    const char *old_status;
+    const char *new_status;
+    const char *name;
+    char uuid[UUID_LEN + 1];
+    char stamp[32];
+    struct tm tm;
+    time_t now;
+
+    snprintf(uuid, sizeof uuid, UUID_FMT, UUID_ARGS(&pPSU->header_.uuid));
+    entry = shash_find_data(last, uuid);
+
+    if (ovsrec_power_supply_is_deleted(pPSU)) {
+        if (!entry)
+            return;
+        name = entry->name;
+        old_status = entry->status;
+        new_status = NULL;
+    } else {
+        new_status = pPSU->status ? pPSU->status : "";
+        if (entry && 0 == strcmp(entry->status, new_status))
+            return;
+        name = pPSU->name;
+        old_status = entry ? entry->status : NULL;
+    }
+
+    if (print) {
+        now = time(NULL);
+        localtime_r(&now, &tm);
+        strftime(stamp, sizeof stamp, "%Y-%m-%d %H:%M:%S", &tm);
+        vty_out(vty, "%-21s%-15s%-15s%-15s%s", stamp, name,
+                old_status ? (format_psu_string((char *)old_status) ?: old_status)
+                           : "-",
+                new_status ? (format_psu_string((char *)new_status) ?: new_status)
+                           : "-",
+                VTY_NEWLINE);
+        fflush(stdout);
+    }
+
+    if (!new_status) {
+        shash_find_and_delete(last, uuid);
+        free(entry->name);
+        free(entry->status);
+        free(entry);
+        return;
+    }
+
+    if (!entry) {
+        entry = xzalloc(sizeof *entry);
+        shash_add(last, uuid, entry);
+    }
+    free(entry->name);
+    free(entry->status);
+    entry->name = xstrdup(name);
+    entry->status = xstrdup(new_status);
+}
+
+/*
+ * Function        : cli_system_watch_psu
+ * Resposibility   : Print power supply status changes as they are
+ *                   committed to OVSDB, until interrupted with Ctrl-C.
+ *                   A private IDL connection with change tracking on the
+ *                   Power_supply status column is used, so each wakeup
+ *                   only visits the rows that changed since the last
+ *                   seqno instead of rescanning and resorting the table.
+ * Return      : CMD_SUCCESS, or CMD_OVSDB_FAILURE if the connection to
+ *               OVSDB is lost
+ */
+int
+cli_system_watch_psu(void)
+{
+    const struct ovsrec_power_supply *pPSU = NULL;
+    struct ovsdb_idl *watch_idl;
+    struct shash last = SHASH_INITIALIZER(&last);
+    struct shash_node *node, *next;
+    struct sigaction sa, old_sa;
+    unsigned int seqno;
+    bool synced = false;
+    int rc = CMD_SUCCESS;
+    char *remote;
+
+    remote = xasprintf("unix:%s/db.sock", ovs_rundir());
+    watch_idl = ovsdb_idl_create(remote, &ovsrec_idl_class, false, true);
+    free(remote);
+
+    ovsdb_idl_add_table(watch_idl, &ovsrec_table_power_supply);
+    ovsdb_idl_add_column(watch_idl, &ovsrec_power_supply_col_name);
+    ovsdb_idl_add_column(watch_idl, &ovsrec_power_supply_col_status);
+    ovsdb_idl_track_add_column(watch_idl, &ovsrec_power_supply_col_name);
+    ovsdb_idl_track_add_column(watch_idl, &ovsrec_power_supply_col_status);
+    seqno = ovsdb_idl_get_seqno(watch_idl);
+
+    latch_init(&watch_latch);
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = watch_psu_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_sa);
+
+    vty_out(vty,"%s",VTY_NEWLINE);
+    vty_out(vty,"Watching power supply status, press Ctrl-C to stop%s",
+            VTY_NEWLINE);
+    vty_out(vty,"%-21s%-15s%-15s%-15s%s","Time","Name","Old Status",
+            "New Status",VTY_NEWLINE);
+    vty_out(vty,"%s%s",
+            "-----------------------------------------------------------",
+            VTY_NEWLINE);
+    fflush(stdout);
+
+    while (!latch_poll(&watch_latch))
+    {
+        ovsdb_idl_run(watch_idl);
+        if (!ovsdb_idl_is_alive(watch_idl))
+        {
+            vty_out(vty,"Lost connection to OVSDB%s",VTY_NEWLINE);
+            rc = CMD_OVSDB_FAILURE;
+            break;
+        }
+
+        if (ovsdb_idl_has_ever_connected(watch_idl) &&
+            seqno != ovsdb_idl_get_seqno(watch_idl))
+        {
+            seqno = ovsdb_idl_get_seqno(watch_idl);
+            /* the first update is the initial snapshot: remember it
+               without printing, then report deltas only */
+            OVSREC_POWER_SUPPLY_FOR_EACH_TRACKED(pPSU, watch_idl)
+            {
+                watch_psu_report(&last, pPSU, synced);
+            }
+            ovsdb_idl_track_clear(watch_idl);
+            synced = true;
+        }
+
+        ovsdb_idl_wait(watch_idl);
+        latch_wait(&watch_latch);
+        poll_block();
+    }
+    vty_out(vty,"%s",VTY_NEWLINE);
+
+    sigaction(SIGINT, &old_sa, NULL);
+    latch_destroy(&watch_latch);
+
+    SHASH_FOR_EACH_SAFE(node, next, &last)
+    {
+        struct watch_psu_entry *entry = node->data;
+        free(entry->name);
+        free(entry->status);
+        free(entry);
+        shash_delete(&last, node);
+    }
+    shash_destroy(&last);
+    ovsdb_idl_destroy(watch_idl);
+
+    return rc;
+}
+
 
 DEFUN (cli_platform_show_psu,
         cli_platform_show_psu_cmd,
@@ -157,6 +630,41 @@ DEFUN (cli_platform_show_psu,
     return cli_system_get_psu();
 }
 
+DEFUN (cli_platform_show_psu_watch,
+        cli_platform_show_psu_watch_cmd,
+        "show system power-supply watch",
+        SHOW_STR
+        SYS_STR
+        PSU_STR
+        "Print power supply status changes until interrupted\n")
+{
+    return cli_system_watch_psu();
+}
+
+DEFUN (cli_platform_show_psu_json,
+        cli_platform_show_psu_json_cmd,
+        "show system power-supply json",
+        SHOW_STR
+        SYS_STR
+        PSU_STR
+        JSON_STR)
+{
+    return cli_system_get_psu_json(NULL);
+}
+
+DEFUN (cli_platform_show_psu_subsystem_json,
+        cli_platform_show_psu_subsystem_json_cmd,
+        "show system power-supply subsystem WORD json",
+        SHOW_STR
+        SYS_STR
+        PSU_STR
+        "Power supplies of one subsystem\n"
+        "Subsystem name\n"
+        JSON_STR)
+{
+    return cli_system_get_psu_json(argv[0]);
+}
+
 /*
  * Function : powerd_ovsdb_init
  * Responsibility : Initialise the powerd Related OVSDB table
@@ -175,6 +683,8 @@ void powerd_ovsdb_init()
 
     /* Add powersupply column into subsystem. */
     ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_power_supplies);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_name);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_external_ids);
 }
 
 /*
@@ -194,4 +704,7 @@ void cli_pre_init(void)
 void cli_post_init(void)
 {
     install_element (ENABLE_NODE, &cli_platform_show_psu_cmd);
+    install_element (ENABLE_NODE, &cli_platform_show_psu_watch_cmd);
+    install_element (ENABLE_NODE, &cli_platform_show_psu_json_cmd);
+    install_element (ENABLE_NODE, &cli_platform_show_psu_subsystem_json_cmd);
 }
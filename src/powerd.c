@@ -26,12 +26,16 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <getopt.h>
 #include <limits.h>
+#include <malloc.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
 
 #include "config.h"
 #include "command-line.h"
@@ -46,6 +50,10 @@
 #include "stream-ssl.h"
 #include "stream.h"
 #include "svec.h"
+#include "dynamic-string.h"
+#include "smap.h"
+#include "sset.h"
+#include "hash.h"
 #include "timeval.h"
 #include "unixctl.h"
 #include "util.h"
@@ -55,6 +63,13 @@
 #include "coverage.h"
 #include "config-yaml.h"
 #include "powerd.h"
+#include "powerd_i2c.h"
+#include "powerd_probes.h"
+#include "powerd_metrics.h"
+#include "powerd_profile.h"
+#include "powerd_trace.h"
+#include "powerd_watch.h"
+#include "powerd_shm_writer.h"
 #include "eventlog.h"
 
 static struct ovsdb_idl *idl;
@@ -62,6 +77,7 @@ static struct ovsdb_idl *idl;
 static unsigned int idl_seqno;
 
 static unixctl_cb_func powerd_unixctl_dump;
+static powerd_watch_cb powerd_desc_changed;
 
 static bool cur_hw_set = false;
 
@@ -70,20 +86,176 @@ YamlConfigHandle yaml_handle;
 struct shash psu_data;       /* struct locl_psu (all psus) */
 struct shash subsystem_data; /* struct locl_subsystem */
 
+/* i2c time (ms) that one wakeup may queue on each bus, 0 for no limit */
+static int poll_budget = POLL_BUDGET;
+
+/* psus that are due for a read, oldest first. Reads that do not fit in
+   the budget of one wakeup stay queued and go first at the next one. */
+static struct locl_psu *poll_queue_head;
+static struct locl_psu *poll_queue_tail;
+static long long int poll_resume;   /* time (ms) to resume queued reads */
+
+/* poll budget accounting, reported by ops-powerd/dump */
+static struct {
+    unsigned long long int wakeups;  /* wakeups that read at least one psu */
+    unsigned long long int reads;    /* psu reads queued */
+    unsigned long long int overruns; /* wakeups where a bus ran out of budget */
+    unsigned long long int carried;  /* psu reads carried to a later wakeup */
+} poll_stats;
+
+/* insertion-to-publish latency histogram, reported by ops-powerd/dump.
+   Bucket i counts latencies below hotswap_bounds[i] ms; the last bucket
+   counts everything slower. */
+static const int hotswap_bounds[] = { 100, 250, 500, 750, 1000, 2000 };
+#define HOTSWAP_BUCKETS (ARRAY_SIZE(hotswap_bounds) + 1)
+static struct {
+    unsigned long long int insertions; /* absent to present transitions */
+    unsigned long long int bounces;    /* bursts that settled on absent */
+    unsigned long long int hist[HOTSWAP_BUCKETS];
+    long long int max;                 /* slowest insertion (ms) */
+} hotswap_stats;
+static unsigned int hotswap_pending;   /* psus with hotswap_publish set */
+
+/* transactions committed, reported by ops-powerd/metrics */
+static struct {
+    unsigned long long int commits;
+    unsigned long long int failures;
+} txn_stats;
+
+/* wakeups and cpu use of the daemon, reported by ops-powerd/dump and
+   ops-powerd/metrics. Rates are over the last full window of
+   IDLE_WINDOW ms, rolled over lazily at the first wakeup after it ends */
+#define IDLE_WINDOW  60000
+static struct {
+    unsigned long long int wakeups;   /* main loop iterations */
+    unsigned long long int skipped;   /* cycles with nothing to publish */
+    long long int start;              /* time (ms) counting started */
+    long long int window_start;       /* time (ms) the window started */
+    unsigned long long int window_wakeups; /* wakeups at window_start */
+    long long int window_cpu;         /* cpu (ms) at window_start */
+    double wakeups_per_min;           /* over the last full window */
+    double cpu_ms_per_hour;           /* over the last full window */
+} idle_stats;
+
+/* timer slack (ms), set with --timer-slack: the kernel may delay a wakeup
+   by up to this much to coalesce it with others, and psus due within it
+   are read together */
+static int timer_slack = 0;
+
+/* read every register bit on its own, set with --single-reads */
+static bool single_reads = false;
+
+/* parse whole devices files, set with --parse-all-devices */
+static bool parse_all_devices = false;
+
+/* duration of powerd_run__(), reported by ops-powerd/metrics */
+static struct powerd_histogram cycle_hist;
+
+/* shard served by this instance, set with --shard; shard_count is 0
+   when a single instance serves every subsystem */
+static int shard_id;
+static int shard_count;
+
+/* hot standby: while another instance holds the lock, subsystems are
+   discovered and the published psu state is mirrored, but nothing is
+   written to the db or the hardware */
+static struct {
+    bool standby;               /* lock not held */
+    bool contended;             /* lock held by another instance */
+    long long int acquired;     /* time (ms) the lock was taken over */
+    unsigned int takeovers;     /* times the lock was taken over */
+    long long int last_latency; /* ms from takeover to first publish */
+    long long int max_latency;
+} standby = { .standby = true };
+
+/* one event of a fault injection scenario */
+struct scenario_event {
+    long long int offset;       /* ms after the scenario was loaded */
+    char glob[64];              /* psu names the event applies to */
+    enum psustatus status;      /* override, or PSU_STATUS_OVERRIDE_NONE */
+    int matched;                /* psus matched when it was injected */
+    long long int injected;     /* time (us) it was injected, or 0 */
+    long long int latency;      /* us from injection to commit, or -1 */
+};
+
+/* fault injection scenario loaded with ops-powerd/scenario-load */
+static struct {
+    struct scenario_event *events;
+    size_t n_events;
+    size_t allocated;
+    size_t next;                /* first event not injected yet */
+    size_t unresolved;          /* first event without a latency */
+    long long int start;        /* time (ms) the scenario was loaded */
+    char *file;
+} scenario;
+
+/* unix socket serving ops-powerd/metrics, set with --metrics */
+static char *metrics_path;
+
+/* register trace to record to or replay from, set with --record and
+   --replay; replay_fast answers from the trace without recorded delays */
+static char *record_path;
+static char *replay_path;
+static bool replay_fast = false;
+
+/* main loop stall deadline (ms, 0: no watchdog), set with --watchdog, and
+   whether to abort on a stall, set with --watchdog-abort */
+static long long int watchdog_deadline = 0;
+static bool watchdog_abort = false;
+
+/* set while some subsystem has rows that have not been committed, so the
+   next reconfigure pass retries them even if the db has not changed */
+static bool bootstrap_pending = false;
+
+/* set when local psu or power state changed since the last publish
+   cycle; together with the idl seqno, decides whether powerd_run__()
+   has to compare local state with the db at all */
+static bool publish_dirty = true;
+static unsigned int publish_seqno;
+
+/* while standing by, the published state is mirrored again only when the
+   db has changed since the last mirror, or psus have been added */
+static bool mirror_dirty = true;
+static unsigned int mirror_seqno;
+
+/* set when psu state was read or changed, as by a test override, since
+   the shared memory snapshot was last written; the snapshot also carries the time of the last read, so it is
+   written after every read and not only on change */
+static bool shm_dirty = true;
+
+/* set once opening the shared memory segment failed, until the next
+   takeover */
+static bool shm_failed = false;
+
 /* map psustatus enum to the equivalent string */
 static const char *
 psu_status_to_string(enum psustatus status)
 {
-    VLOG_DBG("psu status is %d", status);
     if ((unsigned int)status < sizeof(psu_status)/sizeof(const char *)) {
-        VLOG_DBG("psu status is %s", psu_status[status]);
         return(psu_status[status]);
     } else {
-        VLOG_DBG("psu status is %s", psu_status[PSU_STATUS_OK]);
         return(psu_status[PSU_STATUS_OK]);
     }
 }
 
+/* map psustatus enum to the status of the shared memory snapshot */
+static enum powerd_shm_status
+psu_status_to_shm(enum psustatus status)
+{
+    switch (status) {
+    case PSU_STATUS_OK:
+        return(POWERD_SHM_OK);
+    case PSU_STATUS_FAULT_INPUT:
+        return(POWERD_SHM_FAULT_INPUT);
+    case PSU_STATUS_FAULT_OUTPUT:
+        return(POWERD_SHM_FAULT_OUTPUT);
+    case PSU_STATUS_FAULT_ABSENT:
+        return(POWERD_SHM_FAULT_ABSENT);
+    default:
+        return(POWERD_SHM_UNKNOWN);
+    }
+}
+
 static enum psustatus
 psu_string_to_status(const char *string)
 {
@@ -126,14 +298,11 @@ lookup_psu(const char *name)
     return(NULL);
 }
 
+/* interpret the result of a bit operation read */
 static enum bit_op_result
-get_bool_op(const char *subsystem_name, const char *psu_name, const i2c_bit_op *psu_op)
+bit_op_result(const char *subsystem_name, const char *psu_name,
+              const i2c_bit_op *psu_op, int rc, uint32_t value)
 {
-    uint32_t value;
-    int rc;
-
-    rc = i2c_reg_read(yaml_handle, subsystem_name, psu_op, &value);
-
     if (rc != 0) {
         VLOG_WARN("subsystem %s: unable to read byte for psu %s status (%d)",
             subsystem_name, psu_name, rc);
@@ -143,38 +312,401 @@ get_bool_op(const char *subsystem_name, const char *psu_name, const i2c_bit_op *
     return (value == psu_op->bit_mask) ? BIT_OP_STATUS_OK : BIT_OP_STATUS_BAD;
 }
 
-static void
-powerd_read_psu(struct locl_psu *psu)
+/* build a request reading presence, input, and output of a psu */
+static struct powerd_i2c_req *
+powerd_psu_read_req(struct locl_psu *psu, powerd_i2c_cb *cb)
 {
     const YamlPsu *yaml_psu = psu->yaml_psu;
+    struct powerd_i2c_req *req;
+
+    req = powerd_i2c_req_create(I2C_PRIO_STATUS, psu->subsystem->name,
+                                psu->name, cb);
+    powerd_i2c_req_add_read(req, yaml_psu->psu_present);
+    powerd_i2c_req_add_read(req, yaml_psu->psu_input_ok);
+    powerd_i2c_req_add_read(req, yaml_psu->psu_output_ok);
+
+    return(req);
+}
+
+/************************************************************************//**
+ * Function that recalculates the power budget of a subsystem.
+ *
+ * Capacity is the rated output of the psus that are ok. Redundancy
+ * compares the number of psus that are ok with the number required to
+ * power the subsystem. The budget is only marked for publishing if the
+ * redundancy state changed or the capacity moved by more than the
+ * deadband since it was last written.
+ ***************************************************************************/
+static void
+powerd_update_power_budget(struct locl_subsystem *subsystem)
+{
+    int required = subsystem->psus_required;
+    int ok = subsystem->n_psus_ok;
+    int capacity = ok * subsystem->psu_rated_watts;
+
+    if (ok >= 2 * required) {
+        subsystem->redundancy = POWER_REDUNDANCY_N_PLUS_N;
+    } else if (ok >= required + 1) {
+        subsystem->redundancy = POWER_REDUNDANCY_N_PLUS_1;
+    } else if (ok == required) {
+        subsystem->redundancy = POWER_REDUNDANCY_N;
+    } else {
+        subsystem->redundancy = POWER_REDUNDANCY_DEGRADED;
+    }
+
+    if (!subsystem->power_published ||
+        subsystem->redundancy != subsystem->published_redundancy ||
+        abs(capacity - subsystem->published_capacity) >
+            subsystem->power_deadband) {
+        subsystem->power_dirty = true;
+        publish_dirty = true;
+    }
+}
+
+/* set psu status, keeping the subsystem power budget up to date */
+static void
+powerd_psu_set_status(struct locl_psu *psu, enum psustatus status)
+{
+    struct locl_subsystem *subsystem = psu->subsystem;
+
+    if (status == psu->status) {
+        return;
+    }
+
+    POWERD_PROBE3(psu_status, psu->name, psu_status_to_string(psu->status),
+                  psu_status_to_string(status));
+
+    publish_dirty = true;
+    shm_dirty = true;
+
+    if (psu->status == PSU_STATUS_OK) {
+        subsystem->n_psus_ok--;
+    }
+    if (status == PSU_STATUS_OK) {
+        subsystem->n_psus_ok++;
+    }
+    psu->status = status;
+
+    powerd_update_power_budget(subsystem);
+}
+
+/* add a 0/1 sample to a running mean and variance */
+static void
+powerd_ewma_add(struct powerd_ewma *ewma, bool sample)
+{
+    double diff = (sample ? 1.0 : 0.0) - ewma->mean;
+    double incr = DEGRADED_ALPHA * diff;
+
+    ewma->mean += incr;
+    ewma->var = (1.0 - DEGRADED_ALPHA) * (ewma->var + diff * incr);
+}
+
+/************************************************************************//**
+ * Function that feeds the result of one psu read into its health metrics
+ * and raises or clears the degraded flag.
+ *
+ * A psu is degraded when its status flaps, its reads fail, or its input
+ * or output ok signal flickers (high variance, as opposed to a steady
+ * fault) more than the subsystem thresholds allow. The flag is cleared
+ * once every metric has dropped below half of its threshold. Each read
+ * costs a constant amount of work and memory.
+ ***************************************************************************/
+static void
+powerd_psu_analyze(struct locl_psu *psu, enum bit_op_result present,
+                   enum bit_op_result input_ok, enum bit_op_result output_ok,
+                   bool changed)
+{
+    const struct locl_subsystem *subsystem = psu->subsystem;
+    const char *reason = NULL;
+    bool below_half;
+
+    powerd_ewma_add(&psu->flap_stat, changed);
+    powerd_ewma_add(&psu->fail_stat, present == BIT_OP_FAIL ||
+                                     input_ok == BIT_OP_FAIL ||
+                                     output_ok == BIT_OP_FAIL);
+    if (present == BIT_OP_STATUS_OK) {
+        if (input_ok != BIT_OP_FAIL) {
+            powerd_ewma_add(&psu->input_stat, input_ok == BIT_OP_STATUS_BAD);
+        }
+        if (output_ok != BIT_OP_FAIL) {
+            powerd_ewma_add(&psu->output_stat,
+                            output_ok == BIT_OP_STATUS_BAD);
+        }
+    }
+
+    if (psu->flap_stat.mean > subsystem->degraded_flap) {
+        reason = "flapping";
+    } else if (psu->fail_stat.mean > subsystem->degraded_fail) {
+        reason = "read_failures";
+    } else if (psu->input_stat.var > subsystem->degraded_flicker) {
+        reason = "input_flicker";
+    } else if (psu->output_stat.var > subsystem->degraded_flicker) {
+        reason = "output_flicker";
+    }
+
+    below_half = psu->flap_stat.mean <= subsystem->degraded_flap / 2 &&
+                 psu->fail_stat.mean <= subsystem->degraded_fail / 2 &&
+                 psu->input_stat.var <= subsystem->degraded_flicker / 2 &&
+                 psu->output_stat.var <= subsystem->degraded_flicker / 2;
+
+    if (!psu->degraded && reason != NULL) {
+        psu->degraded = true;
+        psu->degraded_reason = reason;
+        publish_dirty = true;
+        VLOG_WARN("psu %s is degraded (%s)", psu->name, reason);
+        log_event("POWER_DEGRADED",
+            EV_KV("psu", "%s", psu->name),
+            EV_KV("reason", "%s", reason),
+            EV_KV("subsystem", "%s", subsystem->name));
+    } else if (psu->degraded && below_half) {
+        psu->degraded = false;
+        publish_dirty = true;
+        VLOG_INFO("psu %s is no longer degraded", psu->name);
+        log_event("POWER_DEGRADED_CLEAR",
+            EV_KV("psu", "%s", psu->name),
+            EV_KV("reason", "%s", psu->degraded_reason),
+            EV_KV("subsystem", "%s", subsystem->name));
+        psu->degraded_reason = NULL;
+    }
+}
+
+/* set psu status from the result of a read request */
+static void
+powerd_psu_read_result(struct locl_psu *psu, const struct powerd_i2c_req *req)
+{
+    const char *subsystem_name = psu->subsystem->name;
     enum bit_op_result present, input_ok, output_ok;
+    enum psustatus status;
 
-    VLOG_DBG("reading psu %s state", psu->name);
-    /* read presence, input, and output */
-    present = get_bool_op(psu->subsystem->name, psu->name, yaml_psu->psu_present);
+    if (req->rcs[0] == I2C_RC_NO_DEVICE) {
+        /* the device holding the present bit did not answer, as a psu
+           that holds its own status registers does once pulled; its ok
+           bits mean nothing */
+        present = input_ok = output_ok = BIT_OP_STATUS_BAD;
+    } else {
+        present = bit_op_result(subsystem_name, psu->name,
+                                req->ops[0], req->rcs[0], req->values[0]);
 
-    input_ok = get_bool_op(psu->subsystem->name, psu->name, yaml_psu->psu_input_ok);
+        input_ok = bit_op_result(subsystem_name, psu->name,
+                                 req->ops[1], req->rcs[1], req->values[1]);
 
-    output_ok = get_bool_op(psu->subsystem->name, psu->name, yaml_psu->psu_output_ok);
+        output_ok = bit_op_result(subsystem_name, psu->name,
+                                  req->ops[2], req->rcs[2], req->values[2]);
+    }
 
     if (present == BIT_OP_STATUS_BAD) {
-        psu->status = PSU_STATUS_FAULT_ABSENT;
+        status = PSU_STATUS_FAULT_ABSENT;
     } else if (input_ok == BIT_OP_STATUS_BAD) {
-        psu->status = PSU_STATUS_FAULT_INPUT;
+        status = PSU_STATUS_FAULT_INPUT;
     } else if (output_ok == BIT_OP_STATUS_BAD) {
-        psu->status = PSU_STATUS_FAULT_OUTPUT;
+        status = PSU_STATUS_FAULT_OUTPUT;
     } else {
-        psu->status = PSU_STATUS_OK;
+        status = PSU_STATUS_OK;
     }
 
     if (present == BIT_OP_FAIL ||
         input_ok == BIT_OP_FAIL ||
         output_ok == BIT_OP_FAIL) {
-        psu->status = PSU_STATUS_UNKNOWN;
+        status = PSU_STATUS_UNKNOWN;
     }
 
     if (psu->test_status != PSU_STATUS_OVERRIDE_NONE) {
-        psu->status = psu->test_status;
+        status = psu->test_status;
+    }
+
+    if (status == PSU_STATUS_FAULT_ABSENT) {
+        psu->absent_seen = time_msec();
+    }
+
+    /* the first reading of a psu is not a transition */
+    powerd_psu_analyze(psu, present, input_ok, output_ok,
+                       psu->read_once && status != psu->status);
+    powerd_psu_set_status(psu, status);
+}
+
+/************************************************************************//**
+ * Function that counts and reports psu status transitions to the event
+ * log.
+ *
+ * Called for every psu after each read, except the first one and those of
+ * a psu that is settling after insertion, which is called once with the
+ * status before insertion when it settles; so only real, settled
+ * transitions change the transition count and time. Events are rate
+ * limited per psu; transitions that find the token bucket empty are
+ * counted, and the count is reported in a single summary event as soon as
+ * a token becomes available again, even if the psu has stopped changing by
+ * then.
+ ***************************************************************************/
+static void
+powerd_log_status(struct locl_psu *psu, enum psustatus old_status)
+{
+    bool changed = (psu->status != old_status);
+
+    if (changed && psu->read_once) {
+        psu->n_transitions++;
+        psu->last_change = time_wall_msec();
+    }
+
+    if (!changed && psu->events_suppressed == 0) {
+        return;
+    }
+
+    if (!token_bucket_withdraw(&psu->event_tb, PSU_EVENT_TOKENS)) {
+        if (changed) {
+            psu->events_suppressed++;
+        }
+        return;
+    }
+
+    if (psu->events_suppressed != 0) {
+        log_event("POWER_STATUS_SUPPRESSED",
+            EV_KV("psu", "%s", psu->name),
+            EV_KV("count", "%u", psu->events_suppressed),
+            EV_KV("subsystem", "%s", psu->subsystem->name));
+        psu->events_suppressed = 0;
+    }
+
+    if (changed) {
+        log_event("POWER_STATUS_CHANGE",
+            EV_KV("psu", "%s", psu->name),
+            EV_KV("old_status", "%s", psu_status_to_string(old_status)),
+            EV_KV("new_status", "%s", psu_status_to_string(psu->status)),
+            EV_KV("subsystem", "%s", psu->subsystem->name));
+    }
+}
+
+/* time (ms) of the first poll slot of a psu after "now". Every psu in a
+   subsystem is polled once per period, but at a fixed phase offset
+   derived from its name, so reads are spread evenly across the period
+   rather than issued back-to-back for every psu at the same instant.
+   Absent psus are polled at least every HOTSWAP_ABSENT_PERIOD ms so that
+   insertions are noticed quickly. */
+static long long int
+powerd_psu_next_slot(const struct locl_psu *psu, long long int now)
+{
+    long long int period = psu->subsystem->polling_period;
+    long long int phase;
+    long long int offset;
+
+    if (psu->status == PSU_STATUS_FAULT_ABSENT) {
+        period = MIN(period, HOTSWAP_ABSENT_PERIOD);
+    }
+    phase = psu->phase_hash % period;
+    offset = ((now - phase) % period + period) % period;
+
+    return(now - offset + period);
+}
+
+/************************************************************************//**
+ * Function that handles a read of a psu in its insertion burst.
+ *
+ * A newly inserted psu is read every HOTSWAP_BURST_INTERVAL ms until
+ * HOTSWAP_SETTLE_READS reads in a row agree (or HOTSWAP_BURST_MAX reads
+ * have been made). Its status is not published while it settles, so the
+ * db sees one update from absent to the final status.
+ ***************************************************************************/
+static void
+powerd_psu_settle(struct locl_psu *psu, enum psustatus old_status,
+                  long long int now)
+{
+    if (psu->status == old_status) {
+        psu->settle_reads++;
+    } else {
+        psu->settle_reads = 1;
+    }
+    psu->burst_reads++;
+
+    if (psu->settle_reads < HOTSWAP_SETTLE_READS &&
+        psu->burst_reads < HOTSWAP_BURST_MAX) {
+        psu->next_poll = now + HOTSWAP_BURST_INTERVAL;
+        return;
+    }
+
+    psu->settling = false;
+    psu->subsystem->n_settling--;
+    publish_dirty = true;
+    if (psu->status == PSU_STATUS_FAULT_ABSENT) {
+        hotswap_stats.bounces++;
+    } else {
+        psu->hotswap_publish = true;
+        hotswap_pending++;
+    }
+    powerd_log_status(psu, psu->settle_from);
+    psu->next_poll = powerd_psu_next_slot(psu, now);
+}
+
+/* psu status read completion (main thread) */
+static void
+powerd_read_psu_done(struct powerd_i2c_req *req)
+{
+    struct locl_psu *psu;
+    enum psustatus old_status;
+    long long int now;
+
+    /* the psu may have been removed while the read was queued */
+    psu = shash_find_data(&psu_data, req->owner);
+    if (psu == NULL) {
+        return;
+    }
+
+    psu->read_pending = false;
+    old_status = psu->status;
+    powerd_psu_read_result(psu, req);
+    psu->last_read = time_wall_msec();
+    shm_dirty = true;
+    now = time_msec();
+
+    if (!psu->read_once) {
+        /* the row was created as unknown before the hardware was read;
+           this fills it in rather than reporting a transition */
+        psu->read_once = true;
+        if (psu->status != old_status) {
+            psu->next_poll = powerd_psu_next_slot(psu, now);
+        }
+        return;
+    }
+
+    if (psu->settling) {
+        powerd_psu_settle(psu, old_status, now);
+        return;
+    }
+
+    if (old_status == PSU_STATUS_FAULT_ABSENT &&
+        psu->status != PSU_STATUS_FAULT_ABSENT) {
+        /* inserted: follow up quickly until input and output settle */
+        hotswap_stats.insertions++;
+        psu->settling = true;
+        psu->settle_from = old_status;
+        psu->settle_reads = 1;
+        psu->burst_reads = 1;
+        psu->subsystem->n_settling++;
+        psu->next_poll = now + HOTSWAP_BURST_INTERVAL;
+        return;
+    }
+
+    powerd_log_status(psu, old_status);
+    if (psu->status != old_status) {
+        /* absent psus are polled on a shorter period */
+        psu->next_poll = powerd_psu_next_slot(psu, now);
+    }
+}
+
+/* queue a read of psu state; the status is updated when it completes */
+static void
+powerd_read_psu_start(struct locl_psu *psu)
+{
+    VLOG_DBG("reading psu %s state", psu->name);
+    psu->read_pending = true;
+    powerd_i2c_submit(powerd_psu_read_req(psu, powerd_read_psu_done));
+}
+
+/* psu status LED write completion (main thread) */
+static void
+powerd_set_psuleds_done(struct powerd_i2c_req *req)
+{
+    if (req->rcs[0] != 0) {
+        VLOG_DBG("Unable to set subsystem %s psu status LED",
+                 req->subsystem);
     }
 }
 
@@ -185,8 +717,8 @@ powerd_set_psuleds(struct locl_subsystem *subsystem)
     struct locl_psu *psu;
     struct shash_node *psu_node;
     enum psustatus status = PSU_STATUS_OK;
+    struct powerd_i2c_req *req;
     unsigned char ledval ;
-    int rc = 0;
 
     psu_info = yaml_get_psu_info(yaml_handle, subsystem->name);
     if (psu_info == NULL) {
@@ -230,175 +762,753 @@ powerd_set_psuleds(struct locl_subsystem *subsystem)
             break;
         }
 
-        rc = i2c_reg_write(yaml_handle, subsystem->name,
-                           psu_info->psu_led, ledval);
-        if (rc) {
-            VLOG_DBG("Unable to set subsystem %s psu status LED",
-                     subsystem->name);
-        }
+        req = powerd_i2c_req_create(I2C_PRIO_LED, subsystem->name,
+                                    subsystem->name, powerd_set_psuleds_done);
+        powerd_i2c_req_add_write(req, psu_info->psu_led, ledval);
+        powerd_i2c_submit(req);
     }
 }
 
 
 /************************************************************************//**
- * Function that creates a new locl_subsystem structure when a new
- *    subsystem is found in ovsdb, reads the psu status for each power
- *    supply, and adds the power supplies into the ovsdb Power_supply table.
- *
- * Logic:
- *      - create a new locl_subsystem structure, add to hash
- *      - tag the subsystem as "unmarked" and as IGNORE
- *      - extract the psu information for this subsys from the hw desc files.
- *      - foreach valid power supply
- *          - read psu status
- *          - add the psu to the Power_supply table (add to transaction)
- *      - tag the subsystem as "marked" and as OK
- *      - commit the transaction
+ * Function that sets the polling period of a subsystem.
  *
- * Returns:  struct locl_subsystem * on success, else NULL on failure
+ * The period is, in order of preference, the value of the
+ * other_config:power_polling_period key of the Subsystem row, the
+ * polling period from the subsystem hardware description, or the
+ * default POLLING_PERIOD. If the period gets shorter, the next poll is
+ * pulled in so that the new period takes effect immediately.
  ***************************************************************************/
-static struct locl_subsystem *
-add_subsystem(const struct ovsrec_subsystem *ovsrec_subsys)
+static void
+powerd_set_polling_period(struct locl_subsystem *subsystem,
+                          const struct ovsrec_subsystem *ovsrec_subsys)
 {
-    struct locl_subsystem *result;
-    int rc;
-    int idx;
-    struct ovsdb_idl_txn *txn;
-    struct ovsrec_power_supply **psu_array;
-    int psu_idx;
-    int psu_count;
-    const char *dir;
-
-    /* get the hw_desc_dir location */
-    dir = ovsrec_subsys->hw_desc_dir;
-
-    if (dir == NULL || strlen(dir) == 0) {
-        VLOG_WARN("No hardware description file directory for subsystem %s", ovsrec_subsys->name);
-        return(NULL);
+    int period;
+    const char *source;
+
+    period = smap_get_int(&ovsrec_subsys->other_config, POLLING_PERIOD_KEY, 0);
+    if (period > 0) {
+        source = "other_config";
+    } else if (subsystem->hw_polling_period > 0) {
+        period = subsystem->hw_polling_period;
+        source = "hw description";
+    } else {
+        period = POLLING_PERIOD * MSEC_PER_SEC;
+        source = "default";
     }
 
-    /* create and initialize basic subsystem information */
-    VLOG_DBG("Adding new subsystem %s", ovsrec_subsys->name);
-    result = (struct locl_subsystem *)malloc(sizeof(struct locl_subsystem));
-    memset(result, 0, sizeof(struct locl_subsystem));
-    (void)shash_add(&subsystem_data, ovsrec_subsys->name, (void *)result);
-    result->name = strdup(ovsrec_subsys->name);
-    result->marked = false;
-    result->valid = false;
-    result->status = PSU_STATUS_UNKNOWN;
-    result->parent_subsystem = NULL;  /* OPS_TODO: find parent subsystem */
-    shash_init(&result->subsystem_psus);
+    if (period < POLLING_PERIOD_MIN) {
+        period = POLLING_PERIOD_MIN;
+    }
 
-    /* since this is a new subsystem, load all of the hardware description
-       information about devices and psus (just for this subsystem).
-       parse psus and device data for subsystem */
-    rc = yaml_add_subsystem(yaml_handle, ovsrec_subsys->name, dir);
+    subsystem->polling_source = source;
+    if (period != subsystem->polling_period) {
+        struct shash_node *psu_node;
+        long long int now = time_msec();
 
-    if (rc != 0) {
-        VLOG_ERR("Error reading h/w desc files for subsystem %s",
-                 ovsrec_subsys->name);
-        return(NULL);
-    }
+        VLOG_DBG("subsystem %s polling period is %d ms (%s)",
+                 subsystem->name, period, source);
+        subsystem->polling_period = period;
 
-    /* need devices data */
-    rc = yaml_parse_devices(yaml_handle, ovsrec_subsys->name);
+        /* move the psus onto the grid of the new period, pulling in any
+           read that is now due earlier than previously scheduled */
+        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
+            struct locl_psu *psu = (struct locl_psu *)psu_node->data;
+            long long int due = powerd_psu_next_slot(psu, now);
 
-    if (rc != 0) {
-        VLOG_ERR("Unable to parse subsystem %s devices file (in %s)",
-                 ovsrec_subsys->name, dir);
-        return(NULL);
+            if (due < psu->next_poll) {
+                psu->next_poll = due;
+            }
+        }
     }
+}
 
-    /* need psu data */
-    rc = yaml_parse_psus(yaml_handle, ovsrec_subsys->name);
+/* read a threshold between 0 and 1 from other_config */
+static double
+powerd_get_ratio(const struct smap *cfg, const char *key, double def)
+{
+    const char *value = smap_get(cfg, key);
+    char *end;
+    double ratio;
 
-    if (rc != 0) {
-        VLOG_ERR("Unable to parse subsystem %s power file (in %s)",
-                 ovsrec_subsys->name, dir);
-        return(NULL);
+    if (value == NULL) {
+        return(def);
     }
 
-    /* OPS_TODO: The thermal info has a polling period, but when we
-       OPS_TODO: have multiple subsystems, that could be tricky to
-       OPS_TODO: implement if there are different polling periods.
-       OPS_TODO: For now, hardwire the polling period to 5 seconds. */
+    ratio = strtod(value, &end);
+    if (*end != '\0' || ratio <= 0.0 || ratio > 1.0) {
+        VLOG_WARN("ignoring invalid value \"%s\" for %s", value, key);
+        return(def);
+    }
 
-    /* prepare to add psus to db */
-    psu_idx = 0;
-    psu_count = yaml_get_psu_count(yaml_handle, ovsrec_subsys->name);
+    return(ratio);
+}
 
-    if (psu_count <= 0) {
-        return(NULL);
+/************************************************************************//**
+ * Function that reads the power budget and psu health parameters of a
+ * subsystem from the other_config column of its Subsystem row.
+ *
+ * The psu rating is not part of the power hardware description, so it is
+ * provided with the other_config:power_psu_rated_watts key; without it the
+ * capacity is reported as 0 and only the redundancy state is meaningful.
+ ***************************************************************************/
+static void
+powerd_set_power_config(struct locl_subsystem *subsystem,
+                        const struct ovsrec_subsystem *ovsrec_subsys)
+{
+    const struct smap *cfg = &ovsrec_subsys->other_config;
+    int rated = MAX(smap_get_int(cfg, POWER_RATED_WATTS_KEY, 0), 0);
+    int required = MAX(smap_get_int(cfg, POWER_PSUS_REQUIRED_KEY, 1), 1);
+    int deadband = MAX(smap_get_int(cfg, POWER_DEADBAND_KEY, POWER_DEADBAND),
+                       0);
+
+    subsystem->degraded_flap = powerd_get_ratio(cfg, DEGRADED_FLAP_KEY,
+                                                DEGRADED_FLAP);
+    subsystem->degraded_fail = powerd_get_ratio(cfg, DEGRADED_FAIL_KEY,
+                                                DEGRADED_FAIL);
+    subsystem->degraded_flicker = powerd_get_ratio(cfg, DEGRADED_FLICKER_KEY,
+                                                   DEGRADED_FLICKER);
+
+    if (rated != subsystem->psu_rated_watts ||
+        required != subsystem->psus_required ||
+        deadband != subsystem->power_deadband) {
+        subsystem->psu_rated_watts = rated;
+        subsystem->psus_required = required;
+        subsystem->power_deadband = deadband;
+        powerd_update_power_budget(subsystem);
     }
+}
 
-    result->valid = true;
-
-    /* subsystem db object has reference array for psus */
-    psu_array = (struct ovsrec_power_supply **)malloc(psu_count * sizeof(struct ovsrec_power_supply *));
-    memset(psu_array, 0, psu_count * sizeof(struct ovsrec_power_supply *));
+/* The thermal description carries the polling period for the subsystem;
+   it is optional, so a missing file is not an error. Called with the
+   description lock held. */
+static void
+powerd_parse_thermal(struct locl_subsystem *subsystem)
+{
+    subsystem->hw_polling_period = 0;
+    if (yaml_parse_thermal(yaml_handle, subsystem->name) == 0) {
+        const YamlThermalInfo *thermal_info;
 
-    txn = ovsdb_idl_txn_create(idl);
+        thermal_info = yaml_get_thermal_info(yaml_handle, subsystem->name);
+        if (thermal_info != NULL && thermal_info->polling_period > 0) {
+            subsystem->hw_polling_period = thermal_info->polling_period;
+        }
+    }
+}
 
-    VLOG_DBG("There are %d psus in subsystem %s", psu_count, ovsrec_subsys->name);
-    log_event("POWER_COUNT", EV_KV("count", "%d", psu_count),
-        EV_KV("subsystem", "%s", ovsrec_subsys->name));
+/* bytes in use on the heap, for the parse statistics */
+static long long int
+powerd_heap_bytes(void)
+{
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2();
+#else
+    struct mallinfo mi = mallinfo();
+#endif
 
-    for (idx = 0; idx < psu_count; idx++) {
-        const YamlPsu *psu = yaml_get_psu(yaml_handle, ovsrec_subsys->name, idx);
+    return((long long int) mi.uordblks + mi.hblkhd);
+}
 
-        struct ovsrec_power_supply *ovs_psu;
-        char *psu_name = NULL;
-        struct locl_psu *new_psu;
-        VLOG_DBG("Adding psu %d in subsystem %s",
-            psu->number,
-            ovsrec_subsys->name);
-
-        /* create a name for the psu from the subsystem name and the
-           psu number */
-        asprintf(&psu_name, "%s-%d", ovsrec_subsys->name, psu->number);
-        /* allocate and initialize basic psu information */
-        new_psu = (struct locl_psu *)malloc(sizeof(struct locl_psu));
-        new_psu->name = psu_name;
-        new_psu->subsystem = result;
-        new_psu->yaml_psu = psu;
-        new_psu->status = PSU_STATUS_OK;
-        /* no test override set */
-        new_psu->test_status = PSU_STATUS_OVERRIDE_NONE;
-
-        /* try to populate psu status with real data */
-        powerd_read_psu(new_psu);
-
-        /* add psu to subsystem psu dictionary */
-        shash_add(&result->subsystem_psus, psu_name, (void *)new_psu);
-        /* add psu to global psu dictionary */
-        shash_add(&psu_data, psu_name, (void *)new_psu);
+/* add the devices that the parsed power description refers to */
+static void
+powerd_psu_devices(const struct locl_subsystem *subsystem,
+                   struct sset *devices)
+{
+    const YamlPsuInfo *psu_info;
+    int psu_count;
+    int idx;
 
-        /* look for existing Power_supply rows */
-        ovs_psu = lookup_psu(psu_name);
+    psu_count = yaml_get_psu_count(yaml_handle, subsystem->name);
+    for (idx = 0; idx < psu_count; idx++) {
+        const YamlPsu *psu = yaml_get_psu(yaml_handle, subsystem->name, idx);
+        const i2c_bit_op *ops[3];
+        size_t i;
 
-        if (ovs_psu == NULL) {
-            /* existing psu doesn't exist in db, create it */
-            ovs_psu = ovsrec_power_supply_insert(txn);
+        if (psu == NULL) {
+            continue;
+        }
+        ops[0] = psu->psu_present;
+        ops[1] = psu->psu_input_ok;
+        ops[2] = psu->psu_output_ok;
+        for (i = 0; i < ARRAY_SIZE(ops); i++) {
+            if (ops[i] != NULL && ops[i]->device != NULL) {
+                sset_add(devices, ops[i]->device);
+            }
         }
+    }
 
-        /* set initial data */
-        ovsrec_power_supply_set_name(ovs_psu, psu_name);
-        ovsrec_power_supply_set_status(ovs_psu,
-            psu_status_to_string(new_psu->status));
+    psu_info = yaml_get_psu_info(yaml_handle, subsystem->name);
+    if (psu_info != NULL && psu_info->psu_led != NULL
+        && psu_info->psu_led->device != NULL) {
+        sset_add(devices, psu_info->psu_led->device);
+    }
+}
 
-        /* add psu to subsystem reference list */
-        psu_array[psu_idx++] = ovs_psu;
+/************************************************************************//**
+ * Function that parses the devices file of a subsystem, after its power
+ * description. Called with the description lock held.
+ *
+ * Unless --parse-all-devices is given, the subsystem is parsed from a
+ * staging directory, and only the devices that the power description
+ * refers to, and the devices in their way such as muxes, are written to
+ * its devices file first.
+ *
+ * Returns: 0 on success, else -1
+ ***************************************************************************/
+static int
+powerd_parse_devices(struct locl_subsystem *subsystem, const char *dir)
+{
+    memset(&subsystem->desc_prune, 0, sizeof subsystem->desc_prune);
+
+    if (subsystem->desc_work_dir != NULL) {
+        struct sset devices;
+        int error;
+
+        sset_init(&devices);
+        powerd_psu_devices(subsystem, &devices);
+        error = powerd_desc_prune(dir, subsystem->desc_work_dir, &devices,
+                                  &subsystem->desc_prune);
+        sset_destroy(&devices);
+        if (error) {
+            VLOG_ERR("Unable to prune subsystem %s devices file (in %s): %s",
+                     subsystem->name, dir, ovs_strerror(error));
+            return(-1);
+        }
     }
 
-    ovsrec_subsystem_set_power_supplies(ovsrec_subsys, psu_array, psu_count);
-    /* execute transaction */
-    ovsdb_idl_txn_commit_block(txn);
-    ovsdb_idl_txn_destroy(txn);
-    free(psu_array);
+    return(yaml_parse_devices(yaml_handle, subsystem->name) == 0 ? 0 : -1);
+}
+
+/************************************************************************//**
+ * Function that parses the hardware description of a new subsystem.
+ *
+ * The i2c worker threads read the parsed descriptions, so hardware access
+ * is excluded while the config-yaml data is being modified. The power
+ * description is parsed before the devices, so that only the devices it
+ * refers to need to be parsed. The time taken and the heap used are kept
+ * for ops-powerd/dump.
+ *
+ * Returns: 0 on success, else -1
+ ***************************************************************************/
+static int
+powerd_load_subsystem_desc(struct locl_subsystem *subsystem, const char *dir)
+{
+    long long int start = time_usec();
+    long long int heap = powerd_heap_bytes();
+    const char *parse_dir = dir;
+    int rc;
+
+    /* the staging directory is refreshed on every load */
+    if (!parse_all_devices) {
+        powerd_desc_unstage(subsystem->desc_work_dir);
+        free(subsystem->desc_work_dir);
+        subsystem->desc_work_dir = powerd_desc_stage(subsystem->name, dir);
+        if (subsystem->desc_work_dir != NULL) {
+            parse_dir = subsystem->desc_work_dir;
+        }
+    }
+
+    powerd_i2c_desc_lock();
+
+    /* parse psus and device data for subsystem */
+    rc = yaml_add_subsystem(yaml_handle, subsystem->name, parse_dir);
+
+    if (rc != 0) {
+        VLOG_ERR("Error reading h/w desc files for subsystem %s",
+                 subsystem->name);
+        goto out;
+    }
+
+    /* need psu data, which names the devices that are needed */
+    rc = yaml_parse_psus(yaml_handle, subsystem->name);
+
+    if (rc != 0) {
+        VLOG_ERR("Unable to parse subsystem %s power file (in %s)",
+                 subsystem->name, dir);
+        goto out;
+    }
+
+    /* need devices data */
+    rc = powerd_parse_devices(subsystem, dir);
+
+    if (rc != 0) {
+        VLOG_ERR("Unable to parse subsystem %s devices file (in %s)",
+                 subsystem->name, dir);
+        goto out;
+    }
+
+    powerd_parse_thermal(subsystem);
+
+out:
+    powerd_i2c_desc_unlock();
+
+    subsystem->desc_parse_usec = time_usec() - start;
+    subsystem->desc_heap_bytes = powerd_heap_bytes() - heap;
+    if (rc == 0) {
+        VLOG_INFO("subsystem %s: parsed hardware description in %lld us, "
+                  "%lld bytes of heap, %s", subsystem->name,
+                  subsystem->desc_parse_usec, subsystem->desc_heap_bytes,
+                  subsystem->desc_work_dir != NULL ? "pruned devices"
+                                                   : "all devices");
+    }
+    return(rc == 0 ? 0 : -1);
+}
+
+/* hash of the status bit operations of a psu and of the devices they
+   address, to spot psus whose description was edited */
+static uint32_t
+powerd_psu_desc_hash(const char *subsystem_name, const YamlPsu *yaml_psu)
+{
+    const i2c_bit_op *ops[] = {
+        yaml_psu->psu_present, yaml_psu->psu_input_ok, yaml_psu->psu_output_ok
+    };
+    uint32_t hash = 0;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(ops); i++) {
+        const YamlDevice *device;
+
+        if (ops[i] == NULL) {
+            continue;
+        }
+        device = yaml_find_device(yaml_handle, subsystem_name,
+                                  ops[i]->device);
+        if (device != NULL) {
+            hash = hash_string(device->bus, hash);
+            hash = hash_int(device->address, hash);
+        }
+        hash = hash_string(ops[i]->device, hash);
+        hash = hash_int(ops[i]->register_address, hash);
+        hash = hash_int(ops[i]->register_size, hash);
+        hash = hash_int(ops[i]->bit_mask, hash);
+    }
+
+    return(hash);
+}
+
+/* create a psu of a subsystem from its hardware description */
+static struct locl_psu *
+powerd_psu_create(struct locl_subsystem *subsystem, const YamlPsu *yaml_psu)
+{
+    char *psu_name = NULL;
+    struct locl_psu *new_psu;
+
+    VLOG_DBG("Adding psu %d in subsystem %s",
+        yaml_psu->number,
+        subsystem->name);
+
+    /* create a name for the psu from the subsystem name and the
+       psu number */
+    asprintf(&psu_name, "%s-%d", subsystem->name, yaml_psu->number);
+    /* allocate and initialize basic psu information */
+    new_psu = (struct locl_psu *)malloc(sizeof(struct locl_psu));
+    memset(new_psu, 0, sizeof(struct locl_psu));
+    new_psu->name = psu_name;
+    new_psu->subsystem = subsystem;
+    new_psu->yaml_psu = yaml_psu;
+    new_psu->desc_hash = powerd_psu_desc_hash(subsystem->name, yaml_psu);
+    new_psu->shm_id = powerd_shm_alloc(psu_name);
+    new_psu->status = PSU_STATUS_UNKNOWN;
+    /* no test override set */
+    new_psu->test_status = PSU_STATUS_OVERRIDE_NONE;
+    token_bucket_init(&new_psu->event_tb, PSU_EVENT_RATE,
+                      PSU_EVENT_BURST * PSU_EVENT_TOKENS);
+    new_psu->events_suppressed = 0;
+    new_psu->phase_hash = hash_string(psu_name, 0);
+    new_psu->poll_queued = false;
+    new_psu->poll_next = NULL;
+    new_psu->read_pending = false;
+
+    /* the row is published as unknown and filled in by the first
+       read, which is due right away, so discovery never waits for
+       the hardware */
+    new_psu->read_once = false;
+    new_psu->next_poll = time_msec();
+
+    /* add psu to subsystem psu dictionary */
+    shash_add(&subsystem->subsystem_psus, psu_name, (void *)new_psu);
+    /* add psu to global psu dictionary */
+    shash_add(&psu_data, psu_name, (void *)new_psu);
+    mirror_dirty = true;
+
+    return(new_psu);
+}
+
+/************************************************************************//**
+ * Function that creates a new locl_subsystem structure when a new
+ *    subsystem is found in ovsdb, reads the psu status for each power
+ *    supply, and adds the power supplies into the ovsdb Power_supply table.
+ *
+ * Logic:
+ *      - create a new locl_subsystem structure, add to hash
+ *      - tag the subsystem as "unmarked" and as IGNORE
+ *      - extract the psu information for this subsys from the hw desc files.
+ *      - foreach valid power supply
+ *          - read psu status
+ *          - add the psu to the Power_supply table (add to transaction)
+ *      - tag the subsystem as "marked" and as OK
+ *      - commit the transaction
+ *
+ * Returns:  struct locl_subsystem * on success, else NULL on failure
+ ***************************************************************************/
+static struct locl_subsystem *
+add_subsystem(const struct ovsrec_subsystem *ovsrec_subsys)
+{
+    struct locl_subsystem *result;
+    int rc;
+    int idx;
+    int psu_count;
+    const char *dir;
+
+    /* get the hw_desc_dir location */
+    dir = ovsrec_subsys->hw_desc_dir;
+
+    if (dir == NULL || strlen(dir) == 0) {
+        VLOG_WARN("No hardware description file directory for subsystem %s", ovsrec_subsys->name);
+        return(NULL);
+    }
+
+    /* create and initialize basic subsystem information */
+    VLOG_DBG("Adding new subsystem %s", ovsrec_subsys->name);
+    result = (struct locl_subsystem *)malloc(sizeof(struct locl_subsystem));
+    memset(result, 0, sizeof(struct locl_subsystem));
+    (void)shash_add(&subsystem_data, ovsrec_subsys->name, (void *)result);
+    result->name = strdup(ovsrec_subsys->name);
+    result->marked = false;
+    result->valid = false;
+    result->status = PSU_STATUS_UNKNOWN;
+    result->parent_subsystem = NULL;  /* OPS_TODO: find parent subsystem */
+    shash_init(&result->subsystem_psus);
+
+    /* watch the description files from now on, also if they fail to
+       load below, so that fixing them is picked up */
+    result->desc_dir = xstrdup(dir);
+    powerd_watch_add(result->name, dir);
+
+    /* since this is a new subsystem, load all of the hardware description
+       information about devices and psus (just for this subsystem). */
+    rc = powerd_load_subsystem_desc(result, dir);
+
+    if (rc != 0) {
+        return(NULL);
+    }
+    powerd_set_polling_period(result, ovsrec_subsys);
+    powerd_set_power_config(result, ovsrec_subsys);
+
+    /* prepare to add psus */
+    psu_count = yaml_get_psu_count(yaml_handle, ovsrec_subsys->name);
+
+    if (psu_count <= 0) {
+        return(NULL);
+    }
+
+    result->valid = true;
+
+    VLOG_DBG("There are %d psus in subsystem %s", psu_count, ovsrec_subsys->name);
+    log_event("POWER_COUNT", EV_KV("count", "%d", psu_count),
+        EV_KV("subsystem", "%s", ovsrec_subsys->name));
+
+    for (idx = 0; idx < psu_count; idx++) {
+        const YamlPsu *psu = yaml_get_psu(yaml_handle, ovsrec_subsys->name, idx);
+
+        powerd_psu_create(result, psu);
+    }
+
+    /* the rows are added by powerd_bootstrap_subsystems() */
+    result->published = false;
 
     return(result);
 }
 
+/************************************************************************//**
+ * Function that adds the Power_supply rows of a subsystem to a transaction.
+ *
+ * Existing rows with a matching name are reused, others are inserted, and
+ * all of them are set with the current status of the psu and referenced
+ * from the Subsystem row.
+ ***************************************************************************/
+static void
+powerd_publish_subsystem(struct locl_subsystem *subsystem,
+                         const struct ovsrec_subsystem *ovsrec_subsys,
+                         struct ovsdb_idl_txn *txn)
+{
+    struct ovsrec_power_supply **psu_array;
+    struct shash_node *node;
+    size_t psu_idx = 0;
+
+    /* subsystem db object has reference array for psus */
+    psu_array = (struct ovsrec_power_supply **)malloc(
+        shash_count(&subsystem->subsystem_psus) *
+        sizeof(struct ovsrec_power_supply *));
+
+    SHASH_FOR_EACH(node, &subsystem->subsystem_psus) {
+        struct locl_psu *psu = (struct locl_psu *)node->data;
+        struct ovsrec_power_supply *ovs_psu;
+        struct smap external_ids;
+
+        /* look for existing Power_supply rows */
+        ovs_psu = lookup_psu(psu->name);
+
+        if (ovs_psu == NULL) {
+            /* existing psu doesn't exist in db, create it */
+            ovs_psu = ovsrec_power_supply_insert(txn);
+        }
+
+        /* set initial data, and claim the row */
+        ovsrec_power_supply_set_name(ovs_psu, psu->name);
+        ovsrec_power_supply_set_status(ovs_psu,
+            psu_status_to_string(psu->status));
+        smap_clone(&external_ids, &ovs_psu->external_ids);
+        smap_replace(&external_ids, POWER_OWNER_KEY, NAME_IN_DAEMON_TABLE);
+        ovsrec_power_supply_set_external_ids(ovs_psu, &external_ids);
+        smap_destroy(&external_ids);
+
+        /* add psu to subsystem reference list */
+        psu_array[psu_idx++] = ovs_psu;
+    }
+
+    ovsrec_subsystem_set_power_supplies(ovsrec_subsys, psu_array, psu_idx);
+    free(psu_array);
+}
+
+/* apply the test override of a psu without waiting for its next read */
+static void
+powerd_apply_override(struct locl_psu *psu)
+{
+    enum psustatus old_status = psu->status;
+
+    if (psu->test_status != PSU_STATUS_OVERRIDE_NONE) {
+        powerd_psu_set_status(psu, psu->test_status);
+        powerd_log_status(psu, old_status);
+    } else {
+        psu->next_poll = time_msec();
+    }
+    poll_immediate_wake();
+}
+
+/* true if "string" names a status that can be used as an override */
+static bool
+powerd_valid_override(const char *string)
+{
+    size_t idx;
+
+    if (strcmp(string, "none") == 0) {
+        return(true);
+    }
+    for (idx = 0; idx < ARRAY_SIZE(psu_status); idx++) {
+        if (strcmp(string, psu_status[idx]) == 0) {
+            return(true);
+        }
+    }
+
+    return(false);
+}
+
+/* drop the loaded scenario; overrides it set are left in place */
+static void
+powerd_scenario_clear(void)
+{
+    free(scenario.events);
+    free(scenario.file);
+    memset(&scenario, 0, sizeof scenario);
+}
+
+/************************************************************************//**
+ * Function that reads a fault injection scenario.
+ *
+ * Each line holds an offset in milliseconds from the start of the
+ * scenario, a shell glob matched against psu names, and a status to
+ * override the matched psus with ("none" clears the override). Blank lines
+ * and lines starting with '#' are ignored. Offsets must not decrease.
+ * Returns NULL on success, otherwise an error message to be freed.
+ ***************************************************************************/
+static char *
+powerd_scenario_load(const char *file)
+{
+    char line[256];
+    int line_number = 0;
+    FILE *stream;
+
+    stream = fopen(file, "r");
+    if (stream == NULL) {
+        return(xasprintf("%s: open failed (%s)", file, ovs_strerror(errno)));
+    }
+
+    powerd_scenario_clear();
+    while (fgets(line, sizeof line, stream) != NULL) {
+        struct scenario_event *event;
+        char status[32];
+        char glob[64];
+        long long int offset;
+        char *p = line + strspn(line, " \t");
+
+        line_number++;
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+
+        if (sscanf(p, "%lld %63s %31s", &offset, glob, status) != 3
+            || offset < 0 || !powerd_valid_override(status)
+            || (scenario.n_events != 0 &&
+                offset < scenario.events[scenario.n_events - 1].offset)) {
+            fclose(stream);
+            powerd_scenario_clear();
+            return(xasprintf("%s:%d: invalid event", file, line_number));
+        }
+
+        if (scenario.n_events >= scenario.allocated) {
+            scenario.events = x2nrealloc(scenario.events, &scenario.allocated,
+                                         sizeof *scenario.events);
+        }
+        event = &scenario.events[scenario.n_events++];
+        event->offset = offset;
+        ovs_strlcpy(event->glob, glob, sizeof event->glob);
+        event->status = psu_string_to_status(status);
+        event->matched = 0;
+        event->injected = 0;
+        event->latency = -1;
+    }
+    fclose(stream);
+
+    scenario.file = xstrdup(file);
+    scenario.start = time_msec();
+
+    return(NULL);
+}
+
+/* inject the scenario events that are due */
+static void
+powerd_scenario_run(void)
+{
+    long long int now = time_msec();
+
+    while (scenario.next < scenario.n_events &&
+           scenario.start + scenario.events[scenario.next].offset <= now) {
+        struct scenario_event *event = &scenario.events[scenario.next++];
+        struct shash_node *node;
+
+        event->injected = time_usec();
+        SHASH_FOR_EACH(node, &psu_data) {
+            struct locl_psu *psu = (struct locl_psu *)node->data;
+
+            if (fnmatch(event->glob, psu->name, 0) == 0) {
+                psu->test_status = event->status;
+                powerd_apply_override(psu);
+                event->matched++;
+            }
+        }
+    }
+}
+
+/* record the injection-to-commit latency of the injected events that
+   were waiting for one. Events whose changes needed no commit get 0. */
+static void
+powerd_scenario_committed(bool committed)
+{
+    long long int now = time_usec();
+
+    while (scenario.unresolved < scenario.next) {
+        struct scenario_event *event = &scenario.events[scenario.unresolved++];
+
+        event->latency = committed ? now - event->injected : 0;
+    }
+}
+
+/* time (ms) at which the next scenario event is due, or LLONG_MAX */
+static long long int
+powerd_scenario_next(void)
+{
+    if (scenario.next >= scenario.n_events) {
+        return(LLONG_MAX);
+    }
+
+    return(scenario.start + scenario.events[scenario.next].offset);
+}
+
+static void
+powerd_unixctl_scenario_load(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                             const char *argv[], void *aux OVS_UNUSED)
+{
+    char *error = powerd_scenario_load(argv[1]);
+
+    if (error != NULL) {
+        unixctl_command_reply_error(conn, error);
+        free(error);
+        return;
+    }
+    poll_immediate_wake();
+    unixctl_command_reply(conn, "Scenario loaded");
+}
+
+static void
+powerd_unixctl_scenario_stop(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                             const char *argv[] OVS_UNUSED,
+                             void *aux OVS_UNUSED)
+{
+    struct shash_node *node;
+
+    powerd_scenario_clear();
+    SHASH_FOR_EACH(node, &psu_data) {
+        struct locl_psu *psu = (struct locl_psu *)node->data;
+
+        if (psu->test_status != PSU_STATUS_OVERRIDE_NONE) {
+            psu->test_status = PSU_STATUS_OVERRIDE_NONE;
+            powerd_apply_override(psu);
+        }
+    }
+    unixctl_command_reply(conn, "Scenario stopped, overrides cleared");
+}
+
+static void
+powerd_unixctl_scenario_show(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                             const char *argv[] OVS_UNUSED,
+                             void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    long long int total = 0;
+    long long int max = 0;
+    size_t n_latencies = 0;
+    size_t i;
+
+    if (scenario.file == NULL) {
+        unixctl_command_reply(conn, "No scenario loaded\n");
+        return;
+    }
+
+    ds_put_format(&ds, "Scenario %s: %zu of %zu events injected\n",
+                  scenario.file, scenario.next, scenario.n_events);
+    for (i = 0; i < scenario.n_events; i++) {
+        const struct scenario_event *event = &scenario.events[i];
+
+        ds_put_format(&ds, "    %8lld ms %-20s %-12s ", event->offset,
+                      event->glob,
+                      event->status == PSU_STATUS_OVERRIDE_NONE
+                      ? "none" : psu_status_to_string(event->status));
+        if (i >= scenario.next) {
+            ds_put_cstr(&ds, "pending\n");
+        } else if (event->latency < 0) {
+            ds_put_format(&ds, "%d psus, not committed yet\n",
+                          event->matched);
+        } else if (event->latency == 0) {
+            ds_put_format(&ds, "%d psus, nothing to commit\n",
+                          event->matched);
+        } else {
+            ds_put_format(&ds, "%d psus, committed in %lld us\n",
+                          event->matched, event->latency);
+            total += event->latency;
+            max = MAX(max, event->latency);
+            n_latencies++;
+        }
+    }
+    if (n_latencies != 0) {
+        ds_put_format(&ds, "Injection to commit: avg %lld us, max %lld us\n",
+                      total / (long long int) n_latencies, max);
+    }
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
 static void
 powerd_unixctl_test(struct unixctl_conn *conn, int argc OVS_UNUSED,
                     const char *argv[], void *aud OVS_UNUSED)
@@ -418,131 +1528,1194 @@ powerd_unixctl_test(struct unixctl_conn *conn, int argc OVS_UNUSED,
     }
     psu = (struct locl_psu *)node->data;
 
-    /* set the override value */
+    /* set the override value, and apply it now rather than at the next
+       read; clearing it makes the psu due for a read */
     psu->test_status = state;
+    powerd_apply_override(psu);
     unixctl_command_reply(conn, "Test power status override set");
 }
 
-/* initialize powerd process */
-static void
-powerd_init(const char *remote)
+/* cpu time (ms), user and system, used by the daemon so far */
+static long long int
+powerd_cpu_msec(void)
 {
-    int retval;
+    struct rusage usage;
 
-    /* initialize subsystems */
-    init_subsystems();
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return(0);
+    }
 
-    /* initialize the yaml handle */
-    yaml_handle = yaml_new_config_handle();
+    return((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000LL
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000);
+}
+
+/* append one gauge or counter sample of a psu */
+static void
+powerd_metrics_put_psu(struct ds *ds, struct ds *labels, const char *name,
+                       const struct locl_psu *psu, unsigned long long int value)
+{
+    ds_clear(labels);
+    powerd_metrics_put_label(labels, "psu", psu->name);
+    ds_put_char(labels, ',');
+    powerd_metrics_put_label(labels, "subsystem", psu->subsystem->name);
+    ds_put_format(ds, "%s{%s} %llu\n", name, ds_cstr(labels), value);
+}
+
+/************************************************************************//**
+ * Function that renders the OpenMetrics page of the daemon.
+ *
+ * Everything comes from local state, the IDL is not looked at, and the
+ * label buffer is kept between scrapes, so a scrape neither allocates
+ * in the steady state nor delays the poll loop for long.
+ ***************************************************************************/
+static void
+powerd_metrics_page(struct ds *ds)
+{
+    static struct ds labels = DS_EMPTY_INITIALIZER;
+    struct shash_node *node;
+    size_t i;
+
+    ds_put_cstr(ds, "# HELP powerd_psu_status Status of the power supply.\n"
+                "# TYPE powerd_psu_status stateset\n");
+    SHASH_FOR_EACH(node, &psu_data) {
+        const struct locl_psu *psu = node->data;
+
+        for (i = 0; i < ARRAY_SIZE(psu_status); i++) {
+            ds_clear(&labels);
+            powerd_metrics_put_label(&labels, "psu", psu->name);
+            ds_put_char(&labels, ',');
+            powerd_metrics_put_label(&labels, "subsystem",
+                                     psu->subsystem->name);
+            ds_put_char(&labels, ',');
+            powerd_metrics_put_label(&labels, "powerd_psu_status",
+                                     psu_status[i]);
+            ds_put_format(ds, "powerd_psu_status{%s} %d\n",
+                          ds_cstr(&labels), psu->status == i);
+        }
+    }
+
+    ds_put_cstr(ds, "# HELP powerd_psu_transitions Status changes of the "
+                "power supply.\n"
+                "# TYPE powerd_psu_transitions counter\n");
+    SHASH_FOR_EACH(node, &psu_data) {
+        const struct locl_psu *psu = node->data;
+
+        powerd_metrics_put_psu(ds, &labels, "powerd_psu_transitions_total",
+                               psu, psu->n_transitions);
+    }
+
+    ds_put_cstr(ds, "# HELP powerd_psu_last_change_timestamp_seconds "
+                "Time of the last status change of the power supply.\n"
+                "# TYPE powerd_psu_last_change_timestamp_seconds gauge\n");
+    SHASH_FOR_EACH(node, &psu_data) {
+        const struct locl_psu *psu = node->data;
+
+        if (psu->last_change != 0) {
+            powerd_metrics_put_psu(ds, &labels,
+                                   "powerd_psu_last_change_timestamp_seconds",
+                                   psu, psu->last_change / MSEC_PER_SEC);
+        }
+    }
+
+    ds_put_cstr(ds, "# HELP powerd_psu_degraded Power supply health "
+                "metrics crossed a threshold.\n"
+                "# TYPE powerd_psu_degraded gauge\n");
+    SHASH_FOR_EACH(node, &psu_data) {
+        const struct locl_psu *psu = node->data;
+
+        powerd_metrics_put_psu(ds, &labels, "powerd_psu_degraded",
+                               psu, psu->degraded);
+    }
+
+    ds_put_cstr(ds, "# HELP powerd_subsystem_psus_ok Power supplies that "
+                "are ok.\n"
+                "# TYPE powerd_subsystem_psus_ok gauge\n");
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        const struct locl_subsystem *subsystem = node->data;
+
+        if (!subsystem->valid) {
+            continue;
+        }
+        ds_clear(&labels);
+        powerd_metrics_put_label(&labels, "subsystem", subsystem->name);
+        ds_put_format(ds, "powerd_subsystem_psus_ok{%s} %d\n",
+                      ds_cstr(&labels), subsystem->n_psus_ok);
+    }
+
+    ds_put_cstr(ds, "# HELP powerd_psu_reads Power supply status reads "
+                "started.\n"
+                "# TYPE powerd_psu_reads counter\n");
+    ds_put_format(ds, "powerd_psu_reads_total %llu\n", poll_stats.reads);
+
+    ds_put_cstr(ds, "# HELP powerd_cycle_seconds Duration of a poll and "
+                "publish cycle.\n"
+                "# TYPE powerd_cycle_seconds histogram\n");
+    powerd_metrics_put_histogram(ds, "powerd_cycle_seconds", "", &cycle_hist);
+
+    ds_put_cstr(ds, "# HELP powerd_transactions Database transactions "
+                "committed.\n"
+                "# TYPE powerd_transactions counter\n");
+    ds_put_format(ds, "powerd_transactions_total{result=\"success\"} %llu\n",
+                  txn_stats.commits - txn_stats.failures);
+    ds_put_format(ds, "powerd_transactions_total{result=\"failure\"} %llu\n",
+                  txn_stats.failures);
+
+    ds_put_cstr(ds, "# HELP powerd_wakeups Main loop wakeups.\n"
+                "# TYPE powerd_wakeups counter\n");
+    ds_put_format(ds, "powerd_wakeups_total %llu\n", idle_stats.wakeups);
+    ds_put_cstr(ds, "# HELP powerd_cpu_seconds Cpu time used, user and "
+                "system.\n"
+                "# TYPE powerd_cpu_seconds counter\n");
+    ds_put_format(ds, "powerd_cpu_seconds_total %.3f\n",
+                  powerd_cpu_msec() / 1000.0);
+
+    powerd_i2c_metrics(ds, &labels);
+}
+
+/* report main loop phase percentiles */
+static void
+powerd_unixctl_profile(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                       const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    powerd_profile_dump(&ds);
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static void
+powerd_unixctl_metrics(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                       const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
+{
+    unixctl_command_reply(conn, powerd_metrics_render());
+}
+
+/* initialize powerd process */
+static void
+powerd_init(const char *remote)
+{
+    int retval;
+
+    /* let the kernel coalesce our timers with those of other daemons;
+       threads created from here on inherit the slack */
+    if (timer_slack > 0 &&
+        prctl(PR_SET_TIMERSLACK, timer_slack * 1000000UL, 0, 0, 0) < 0) {
+        VLOG_WARN("could not set timer slack (%s)", ovs_strerror(errno));
+    }
+
+    /* initialize subsystems */
+    init_subsystems();
+
+    /* initialize the yaml handle */
+    yaml_handle = yaml_new_config_handle();
+
+    /* open the register trace before the first hardware access */
+    if (record_path != NULL) {
+        retval = powerd_trace_record_open(record_path);
+        if (retval) {
+            VLOG_FATAL("%s: could not open for recording (%s)",
+                       record_path, ovs_strerror(retval));
+        }
+    } else if (replay_path != NULL) {
+        retval = powerd_trace_replay_open(replay_path, !replay_fast);
+        if (retval) {
+            VLOG_FATAL("%s: could not replay (%s)",
+                       replay_path, ovs_strerror(retval));
+        }
+    }
+
+    /* watch the description directories of the subsystems added below */
+    powerd_watch_init(powerd_desc_changed);
+
+    /* psus get their snapshot slots as they are discovered */
+    powerd_shm_writer_init();
+
+    /* clear the staging directories of instances that are gone */
+    powerd_desc_init();
+
+    /* start hardware access queues */
+    powerd_i2c_init(yaml_handle);
+    powerd_i2c_set_combine(!single_reads);
+
+    /* create connection to db */
+    idl = ovsdb_idl_create(remote, &ovsrec_idl_class, false, true);
+    idl_seqno = ovsdb_idl_get_seqno(idl);
+    if (shard_count != 0) {
+        char *lock_name = xasprintf("ops_powerd_shard%d", shard_id);
+
+        ovsdb_idl_set_lock(idl, lock_name);
+        free(lock_name);
+    } else {
+        ovsdb_idl_set_lock(idl, "ops_powerd");
+    }
+    ovsdb_idl_verify_write_only(idl);
+
+    /* Register for daemon table. */
+    ovsdb_idl_add_table(idl, &ovsrec_table_daemon);
+    ovsdb_idl_add_column(idl, &ovsrec_daemon_col_name);
+    ovsdb_idl_add_column(idl, &ovsrec_daemon_col_cur_hw);
+    ovsdb_idl_omit_alert(idl, &ovsrec_daemon_col_cur_hw);
+
+    ovsdb_idl_add_table(idl, &ovsrec_table_power_supply);
+    ovsdb_idl_add_column(idl, &ovsrec_power_supply_col_status);
+    ovsdb_idl_omit_alert(idl, &ovsrec_power_supply_col_status);
+    ovsdb_idl_add_column(idl, &ovsrec_power_supply_col_name);
+    ovsdb_idl_omit_alert(idl, &ovsrec_power_supply_col_name);
+    ovsdb_idl_add_column(idl, &ovsrec_power_supply_col_external_ids);
+    ovsdb_idl_omit_alert(idl, &ovsrec_power_supply_col_external_ids);
+
+    ovsdb_idl_add_table(idl, &ovsrec_table_subsystem);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_name);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_power_supplies);
+    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_power_supplies);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_hw_desc_dir);
+    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_hw_desc_dir);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_other_config);
+    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_external_ids);
+    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_external_ids);
+
+    unixctl_command_register("ops-powerd/dump", "", 0, 0,
+                             powerd_unixctl_dump, NULL);
+    unixctl_command_register("ops-powerd/test", "psu state", 2, 2,
+                             powerd_unixctl_test, NULL);
+    unixctl_command_register("ops-powerd/metrics", "", 0, 0,
+                             powerd_unixctl_metrics, NULL);
+    unixctl_command_register("ops-powerd/scenario-load", "file", 1, 1,
+                             powerd_unixctl_scenario_load, NULL);
+    unixctl_command_register("ops-powerd/scenario-stop", "", 0, 0,
+                             powerd_unixctl_scenario_stop, NULL);
+    unixctl_command_register("ops-powerd/scenario-show", "", 0, 0,
+                             powerd_unixctl_scenario_show, NULL);
+
+    unixctl_command_register("ops-powerd/profile", "", 0, 0,
+                             powerd_unixctl_profile, NULL);
+
+    powerd_metrics_init(metrics_path, powerd_metrics_page);
+    powerd_profile_init(watchdog_deadline, watchdog_abort);
+
+    retval = event_log_init("POWER");
+    if(retval < 0) {
+        VLOG_ERR("Event log initialization failed for POWER");
+    }
+}
+
+/* pre-exit shutdown processing */
+static void
+powerd_exit(void)
+{
+    powerd_profile_exit();
+    powerd_metrics_exit();
+    powerd_i2c_exit();
+    powerd_trace_close();
+    powerd_watch_exit();
+    powerd_shm_writer_exit();
+    powerd_desc_exit();
+    ovsdb_idl_destroy(idl);
+}
+
+/* add a psu to the tail of the due queue */
+static void
+powerd_poll_enqueue(struct locl_psu *psu)
+{
+    psu->poll_queued = true;
+    psu->poll_next = NULL;
+    if (poll_queue_tail != NULL) {
+        poll_queue_tail->poll_next = psu;
+    } else {
+        poll_queue_head = psu;
+    }
+    poll_queue_tail = psu;
+}
+
+/* remove a psu from the due queue, given the psu queued before it */
+static void
+powerd_poll_unlink(struct locl_psu *prev, struct locl_psu *psu)
+{
+    if (prev != NULL) {
+        prev->poll_next = psu->poll_next;
+    } else {
+        poll_queue_head = psu->poll_next;
+    }
+    if (poll_queue_tail == psu) {
+        poll_queue_tail = prev;
+    }
+    psu->poll_next = NULL;
+    psu->poll_queued = false;
+}
+
+/* drop a psu that is being deleted from the due queue */
+static void
+powerd_poll_forget(struct locl_psu *psu)
+{
+    struct locl_psu *prev = NULL;
+    struct locl_psu *iter;
+
+    for (iter = poll_queue_head; iter != NULL; iter = iter->poll_next) {
+        if (iter == psu) {
+            powerd_poll_unlink(prev, psu);
+            break;
+        }
+        prev = iter;
+    }
+}
+
+/************************************************************************//**
+ * Function that starts reads of the psus that are due.
+ *
+ * Every psu whose poll slot has come up is appended to the due queue, and
+ * the queue is then walked oldest first, queueing a status read for each
+ * psu as long as the bus that the psu is on has budget left in this
+ * wakeup. The cost of a read is estimated from the recent execution time
+ * of status reads on that bus. Psus left over keep their place in the
+ * queue and go first at the next wakeup, poll_budget ms later, so that
+ * other users of the bus get a turn in between.
+ ***************************************************************************/
+static void
+powerd_poll_psus(void)
+{
+    struct shash_node *node;
+    struct shash_node *psu_node;
+    struct locl_psu *psu;
+    struct locl_psu *prev;
+    unsigned int carried = 0;
+    long long int start = time_msec();
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+        if (!subsystem->valid) {
+            continue;
+        }
+        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
+            psu = (struct locl_psu *)psu_node->data;
+            if (!psu->poll_queued && psu->next_poll <= start + timer_slack) {
+                powerd_poll_enqueue(psu);
+                psu->next_poll = powerd_psu_next_slot(psu,
+                                                      MAX(start,
+                                                          psu->next_poll));
+            }
+        }
+    }
+
+    if (poll_queue_head == NULL || poll_resume > start) {
+        return;
+    }
+
+    poll_stats.wakeups++;
+    powerd_i2c_budget_reset();
+
+    prev = NULL;
+    psu = poll_queue_head;
+    while (psu != NULL) {
+        struct locl_psu *next = psu->poll_next;
+
+        if (psu->read_pending) {
+            /* previous read has not completed yet, skip this slot */
+            powerd_poll_unlink(prev, psu);
+        } else if (powerd_i2c_charge(psu->subsystem->name,
+                                     psu->yaml_psu->psu_present,
+                                     poll_budget * 1000LL)) {
+            powerd_poll_unlink(prev, psu);
+            powerd_read_psu_start(psu);
+            poll_stats.reads++;
+        } else {
+            /* the bus is out of budget, keep the read for next time */
+            carried++;
+            prev = psu;
+        }
+        psu = next;
+    }
+
+    if (carried != 0) {
+        poll_stats.overruns++;
+        poll_stats.carried += carried;
+    }
+    poll_resume = poll_queue_head != NULL ? start + poll_budget : 0;
+}
+
+/* find the db row of a local subsystem */
+static const struct ovsrec_subsystem *
+lookup_subsystem(const char *name)
+{
+    const struct ovsrec_subsystem *subsys;
+
+    OVSREC_SUBSYSTEM_FOR_EACH(subsys, idl) {
+        if (strcmp(subsys->name, name) == 0) {
+            return(subsys);
+        }
+    }
+
+    return(NULL);
+}
+
+/* write the power budget of a subsystem into its external_ids column.
+   returns true if the row was changed */
+static bool
+powerd_publish_power_budget(struct locl_subsystem *subsystem)
+{
+    const struct ovsrec_subsystem *subsys;
+    struct smap external_ids;
+    char buf[16];
+    int capacity = subsystem->n_psus_ok * subsystem->psu_rated_watts;
+
+    subsystem->power_dirty = false;
+    subsys = lookup_subsystem(subsystem->name);
+    if (subsys == NULL) {
+        return(false);
+    }
+
+    smap_clone(&external_ids, &subsys->external_ids);
+    smap_replace(&external_ids, "power_redundancy",
+                 power_redundancy_str[subsystem->redundancy]);
+    snprintf(buf, sizeof buf, "%d", subsystem->n_psus_ok);
+    smap_replace(&external_ids, "power_psus_ok", buf);
+    snprintf(buf, sizeof buf, "%d", capacity);
+    smap_replace(&external_ids, "power_capacity_watts", buf);
+    ovsrec_subsystem_set_external_ids(subsys, &external_ids);
+    smap_destroy(&external_ids);
+
+    subsystem->power_published = true;
+    subsystem->published_capacity = capacity;
+    subsystem->published_redundancy = subsystem->redundancy;
+
+    return(true);
+}
+
+/* commit a transaction, waiting for the result, and account for it.
+   "site" names the caller in tracepoints and logs. */
+static enum ovsdb_idl_txn_status
+powerd_commit_txn(struct ovsdb_idl_txn *txn, const char *site)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    enum ovsdb_idl_txn_status status;
+
+    COVERAGE_INC(powerd_txn_commit);
+    status = ovsdb_idl_txn_commit_block(txn);
+    POWERD_PROBE2(txn_commit, site, status);
+
+    txn_stats.commits++;
+    if (status != TXN_SUCCESS && status != TXN_UNCHANGED) {
+        txn_stats.failures++;
+        VLOG_WARN_RL(&rl, "%s transaction failed (%s)", site,
+                     ovsdb_idl_txn_status_to_string(status));
+    }
+
+    return(status);
+}
+
+/* record the insertion-to-publish latency of psus that settled since the
+   last commit. The insertion time is taken as the last read that still
+   saw the psu absent, so the latency is an upper bound. */
+static void
+powerd_hotswap_published(void)
+{
+    struct shash_node *node;
+    long long int now = time_msec();
+
+    SHASH_FOR_EACH(node, &psu_data) {
+        struct locl_psu *psu = (struct locl_psu *)node->data;
+        long long int latency;
+        size_t i;
+
+        if (!psu->hotswap_publish) {
+            continue;
+        }
+        psu->hotswap_publish = false;
+
+        latency = now - psu->absent_seen;
+        for (i = 0; i < ARRAY_SIZE(hotswap_bounds); i++) {
+            if (latency < hotswap_bounds[i]) {
+                break;
+            }
+        }
+        hotswap_stats.hist[i]++;
+        hotswap_stats.max = MAX(hotswap_stats.max, latency);
+        VLOG_DBG("psu %s published %lld ms after insertion",
+                 psu->name, latency);
+    }
+    hotswap_pending = 0;
+}
+
+/************************************************************************//**
+ * Function that writes the state of every psu to the shared memory
+ * snapshot.
+ *
+ * Like the db, the snapshot is only written by the active instance, and
+ * psus that are settling after insertion keep their previous state until
+ * they are published to the db as well.
+ ***************************************************************************/
+static void
+powerd_shm_publish(void)
+{
+    struct powerd_shm_psu *slots;
+    struct shash_node *node;
+
+    shm_dirty = false;
+    if (!powerd_shm_writer_is_open()) {
+        return;
+    }
+
+    slots = powerd_shm_write_begin();
+    SHASH_FOR_EACH(node, &psu_data) {
+        const struct locl_psu *psu = node->data;
+        struct powerd_shm_psu *slot;
+
+        if (psu->shm_id < 0 || psu->settling) {
+            continue;
+        }
+        slot = &slots[psu->shm_id];
+        slot->status = psu_status_to_shm(psu->status);
+        slot->flags = POWERD_SHM_PSU_USED
+                      | (psu->degraded ? POWERD_SHM_PSU_DEGRADED : 0);
+        slot->transitions = psu->n_transitions;
+        slot->last_change = psu->last_change;
+        slot->last_read = psu->last_read;
+        slot->flap_rate = psu->flap_stat.mean;
+        slot->fail_rate = psu->fail_stat.mean;
+    }
+    powerd_shm_write_end();
+}
+
+/* open the shared memory snapshot when this instance becomes active */
+static void
+powerd_shm_activate(void)
+{
+    char *name;
+    int error;
+
+    if (powerd_shm_writer_is_open() || shm_failed) {
+        return;
+    }
+
+    name = shard_count != 0
+           ? xasprintf("%s.shard%d", POWERD_SHM_NAME, shard_id)
+           : xstrdup(POWERD_SHM_NAME);
+    error = powerd_shm_writer_open(name);
+    if (error) {
+        VLOG_ERR("%s: psu state will not be shared (%s)", name,
+                 ovs_strerror(error));
+        shm_failed = true;
+    }
+    free(name);
+    shm_dirty = true;
+}
+
+/* poll every due psu for new state and report changes */
+static void
+powerd_run__(void)
+{
+    struct ovsdb_idl_txn *txn;
+    const struct ovsrec_power_supply *cfg;
+    const struct ovsrec_daemon *db_daemon;
+    struct shash_node *node;
+    struct locl_psu *psu;
+    bool change = false;
+    long long int start = time_usec();
+
+    POWERD_PROBE(cycle_start);
+    powerd_scenario_run();
+    powerd_poll_psus();
+
+    if (shm_dirty || publish_dirty) {
+        powerd_shm_publish();
+    }
+
+    /* neither the local state nor the db changed since the last cycle
+       compared the two, so there is nothing to publish */
+    if (!publish_dirty && cur_hw_set &&
+        publish_seqno == ovsdb_idl_get_seqno(idl) &&
+        scenario.unresolved == scenario.next) {
+        idle_stats.skipped++;
+        powerd_histogram_add(&cycle_hist, time_usec() - start);
+        POWERD_PROBE(cycle_end);
+        return;
+    }
+    publish_dirty = false;
+
+    txn = ovsdb_idl_txn_create(idl);
+    POWERD_PROBE1(txn_create, "run");
+    OVSREC_POWER_SUPPLY_FOR_EACH(cfg, idl) {
+        const char *status;
+        node = shash_find(&psu_data, cfg->name);
+        if (node == NULL) {
+            /* not ours, or handled by powerd_reconcile_orphans() */
+            continue;
+        }
+        psu = (struct locl_psu *)node->data;
+
+        /* a psu that was just inserted is published once it settles */
+        if (psu->settling) {
+            continue;
+        }
+
+        /* note: only apply changes - don't blindly set data */
+
+        /* calculate and set status */
+        status = psu_status_to_string(psu->status);
+        if (strcmp(status, cfg->status) != 0) {
+            ovsrec_power_supply_set_status(cfg, status);
+            change = true;
+        }
+
+        /* degraded flag, and transition metadata; the latter only moves
+           with real status transitions, so steady psus are not rewritten */
+        if (psu->degraded != psu->degraded_published ||
+            !smap_get(&cfg->external_ids, "degraded") ||
+            psu->n_transitions != psu->transitions_published) {
+            struct smap external_ids;
+
+            smap_clone(&external_ids, &cfg->external_ids);
+            smap_replace(&external_ids, "degraded",
+                         psu->degraded ? "true" : "false");
+            if (psu->n_transitions != psu->transitions_published) {
+                char buf[32];
+
+                snprintf(buf, sizeof buf, "%lld", psu->last_change);
+                smap_replace(&external_ids, STATUS_CHANGED_KEY, buf);
+                snprintf(buf, sizeof buf, "%llu", psu->n_transitions);
+                smap_replace(&external_ids, STATUS_TRANSITIONS_KEY, buf);
+                psu->transitions_published = psu->n_transitions;
+            }
+            ovsrec_power_supply_set_external_ids(cfg, &external_ids);
+            smap_destroy(&external_ids);
+            psu->degraded_published = psu->degraded;
+            change = true;
+        }
+    }
+
+    /* publish power budgets that moved outside the deadband */
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+        if (subsystem->valid && subsystem->power_dirty &&
+            subsystem->n_settling == 0 &&
+            powerd_publish_power_budget(subsystem)) {
+            change = true;
+        }
+    }
+
+    /* If first time through, set cur_hw = 1 */
+    if (!cur_hw_set) {
+        OVSREC_DAEMON_FOR_EACH(db_daemon, idl) {
+            if (strncmp(db_daemon->name, NAME_IN_DAEMON_TABLE,
+                        strlen(NAME_IN_DAEMON_TABLE)) == 0) {
+                ovsrec_daemon_set_cur_hw(db_daemon, (int64_t) 1);
+                cur_hw_set = true;
+                change = true;
+                break;
+            }
+        }
+    }
+
+    /* if a change was made, execute the transaction; on failure, compare
+       again in the next cycle */
+    if (change == true) {
+        enum ovsdb_idl_txn_status status = powerd_commit_txn(txn, "run");
+
+        if (status != TXN_SUCCESS && status != TXN_UNCHANGED) {
+            publish_dirty = true;
+        }
+    }
+    ovsdb_idl_txn_destroy(txn);
+    publish_seqno = ovsdb_idl_get_seqno(idl);
+
+    if (scenario.unresolved < scenario.next) {
+        powerd_scenario_committed(change);
+    }
+
+    if (hotswap_pending != 0) {
+        powerd_hotswap_published();
+    }
+    powerd_histogram_add(&cycle_hist, time_usec() - start);
+    POWERD_PROBE(cycle_end);
+}
+
+/************************************************************************//**
+ * Function that commits the psu rows of every subsystem that has not been
+ * published yet.
+ *
+ * All subsystems discovered in one reconfigure pass share one transaction
+ * and so one round trip to the db. If the commit fails, only those
+ * subsystems are retried, at the next pass of the main loop; subsystems
+ * that were already published are not touched again.
+ ***************************************************************************/
+static void
+powerd_bootstrap_subsystems(void)
+{
+    const struct ovsrec_subsystem *subsys;
+    struct ovsdb_idl_txn *txn = NULL;
+    enum ovsdb_idl_txn_status status;
+    struct shash_node *node;
+    int count = 0;
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+
+        if (!subsystem->valid || subsystem->published) {
+            continue;
+        }
+        subsys = lookup_subsystem(subsystem->name);
+        if (subsys == NULL) {
+            continue;
+        }
+        if (txn == NULL) {
+            txn = ovsdb_idl_txn_create(idl);
+            POWERD_PROBE1(txn_create, "bootstrap");
+        }
+        powerd_publish_subsystem(subsystem, subsys, txn);
+        count++;
+    }
+
+    bootstrap_pending = false;
+    if (txn == NULL) {
+        return;
+    }
+
+    /* execute transaction */
+    status = powerd_commit_txn(txn, "bootstrap");
+    ovsdb_idl_txn_destroy(txn);
+
+    if (status != TXN_SUCCESS && status != TXN_UNCHANGED) {
+        VLOG_INFO("will retry adding psus of %d subsystems", count);
+        bootstrap_pending = true;
+        return;
+    }
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+
+        if (subsystem->valid && lookup_subsystem(subsystem->name) != NULL) {
+            subsystem->published = true;
+        }
+    }
+    VLOG_DBG("added psus of %d subsystems in one transaction", count);
+}
+
+/************************************************************************//**
+ * Function that tells whether a subsystem is served by this instance.
+ *
+ * Without --shard every subsystem is. Otherwise a subsystem belongs to
+ * the shard in its other_config:power_shard key if that is set and
+ * valid, and else to the shard picked by a hash of its name, so the
+ * instances agree on the split without talking to each other.
+ ***************************************************************************/
+static bool
+powerd_shard_owns(const struct ovsrec_subsystem *subsys)
+{
+    int shard;
+
+    if (shard_count == 0) {
+        return(true);
+    }
+
+    shard = smap_get_int(&subsys->other_config, POWER_SHARD_KEY, -1);
+    if (shard < 0 || shard >= shard_count) {
+        shard = hash_string(subsys->name, 0) % shard_count;
+    }
+
+    return(shard == shard_id);
+}
+
+/* true if a Power_supply row was created or claimed by ops-powerd */
+static bool
+powerd_owns_psu_row(const struct ovsrec_power_supply *row)
+{
+    const char *owner = smap_get(&row->external_ids, POWER_OWNER_KEY);
+
+    return(owner != NULL && strcmp(owner, NAME_IN_DAEMON_TABLE) == 0);
+}
+
+/************************************************************************//**
+ * Function that reconciles the Power_supply rows owned by ops-powerd that
+ * no longer match a local psu, for instance after their subsystem was
+ * removed or its hardware description changed.
+ *
+ * Such a row is deleted if no subsystem references it any more, and is
+ * otherwise set to unknown, once. Rows that ops-powerd does not own are
+ * left alone. This runs on every db change but only commits when there
+ * is something to reconcile, so it never causes a write on its own.
+ ***************************************************************************/
+static void
+powerd_reconcile_orphans(void)
+{
+    const struct ovsrec_power_supply *row;
+    const struct ovsrec_power_supply *next;
+    const struct ovsrec_subsystem *subsys;
+    const char *unknown = psu_status_to_string(PSU_STATUS_UNKNOWN);
+    struct ovsdb_idl_txn *txn = NULL;
+    struct sset referenced;
+    struct sset other_shards;
+    int n_deleted = 0;
+    int n_marked = 0;
+    size_t i;
+
+    /* rows of subsystems served by other shards are theirs to handle */
+    sset_init(&referenced);
+    sset_init(&other_shards);
+    OVSREC_SUBSYSTEM_FOR_EACH(subsys, idl) {
+        struct sset *set = powerd_shard_owns(subsys) ? &referenced
+                                                     : &other_shards;
+
+        for (i = 0; i < subsys->n_power_supplies; i++) {
+            sset_add(set, subsys->power_supplies[i]->name);
+        }
+    }
+
+    OVSREC_POWER_SUPPLY_FOR_EACH_SAFE(row, next, idl) {
+        bool in_use;
+
+        if (!powerd_owns_psu_row(row) ||
+            shash_find(&psu_data, row->name) != NULL ||
+            sset_contains(&other_shards, row->name)) {
+            continue;
+        }
+
+        in_use = sset_contains(&referenced, row->name);
+        if (in_use && strcmp(row->status, unknown) == 0) {
+            /* already reconciled */
+            continue;
+        }
+
+        if (txn == NULL) {
+            txn = ovsdb_idl_txn_create(idl);
+            POWERD_PROBE1(txn_create, "reconcile");
+        }
+        if (in_use) {
+            VLOG_INFO("psu %s is no longer managed, marking it %s",
+                      row->name, unknown);
+            ovsrec_power_supply_set_status(row, unknown);
+            n_marked++;
+        } else {
+            VLOG_INFO("deleting unreferenced psu %s", row->name);
+            ovsrec_power_supply_delete(row);
+            n_deleted++;
+        }
+    }
+    sset_destroy(&referenced);
+    sset_destroy(&other_shards);
+
+    if (txn != NULL) {
+        powerd_commit_txn(txn, "reconcile");
+        ovsdb_idl_txn_destroy(txn);
+        VLOG_DBG("reconciled orphan psus: %d deleted, %d marked %s",
+                 n_deleted, n_marked, unknown);
+    }
+}
+
+/************************************************************************//**
+ * Function that copies the psu state published in the db into the local
+ * psus, and marks subsystems whose rows all exist as published.
+ *
+ * Used while standing by and when taking over the lock, so that a new
+ * active instance continues from the state its predecessor published
+ * instead of from unknown, and does not rewrite rows that are in place.
+ * The mirrored status is a starting point only: the first hardware read
+ * of this instance replaces it without counting or logging a transition.
+ ***************************************************************************/
+static void
+powerd_mirror_status(void)
+{
+    const struct ovsrec_power_supply *row;
+    struct shash_node *node;
+
+    mirror_dirty = false;
+    mirror_seqno = ovsdb_idl_get_seqno(idl);
+
+    OVSREC_POWER_SUPPLY_FOR_EACH(row, idl) {
+        struct locl_psu *psu = shash_find_data(&psu_data, row->name);
+        const char *degraded;
+        const char *value;
+
+        if (psu == NULL || row->status == NULL) {
+            continue;
+        }
+
+        /* read_once is left alone: the published status may be stale,
+           as after a restart, so the first reading of the hardware by
+           this instance is still not a transition */
+        powerd_psu_set_status(psu, psu_string_to_status(row->status));
+
+        /* continue the transition history of the previous instance */
+        value = smap_get(&row->external_ids, STATUS_TRANSITIONS_KEY);
+        psu->n_transitions = value != NULL ? strtoull(value, NULL, 10) : 0;
+        psu->transitions_published = psu->n_transitions;
+        value = smap_get(&row->external_ids, STATUS_CHANGED_KEY);
+        psu->last_change = value != NULL ? strtoll(value, NULL, 10) : 0;
+
+        degraded = smap_get(&row->external_ids, "degraded");
+        psu->degraded_published = degraded != NULL &&
+                                  strcmp(degraded, "true") == 0;
+        if (psu->degraded != psu->degraded_published) {
+            psu->degraded = psu->degraded_published;
+            psu->degraded_reason = psu->degraded ? "inherited" : NULL;
+        }
+    }
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+        struct shash_node *psu_node;
 
-    /* create connection to db */
-    idl = ovsdb_idl_create(remote, &ovsrec_idl_class, false, true);
-    idl_seqno = ovsdb_idl_get_seqno(idl);
-    ovsdb_idl_set_lock(idl, "ops_powerd");
-    ovsdb_idl_verify_write_only(idl);
+        if (!subsystem->valid || subsystem->published) {
+            continue;
+        }
+        subsystem->published = true;
+        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
+            if (lookup_psu(psu_node->name) == NULL) {
+                subsystem->published = false;
+                break;
+            }
+        }
+    }
+}
 
-    /* Register for daemon table. */
-    ovsdb_idl_add_table(idl, &ovsrec_table_daemon);
-    ovsdb_idl_add_column(idl, &ovsrec_daemon_col_name);
-    ovsdb_idl_add_column(idl, &ovsrec_daemon_col_cur_hw);
-    ovsdb_idl_omit_alert(idl, &ovsrec_daemon_col_cur_hw);
+/* delete a psu, keeping the counters of its subsystem up to date */
+static void
+powerd_psu_destroy(struct locl_psu *psu)
+{
+    struct locl_subsystem *subsystem = psu->subsystem;
 
-    ovsdb_idl_add_table(idl, &ovsrec_table_power_supply);
-    ovsdb_idl_add_column(idl, &ovsrec_power_supply_col_status);
-    ovsdb_idl_omit_alert(idl, &ovsrec_power_supply_col_status);
-    ovsdb_idl_add_column(idl, &ovsrec_power_supply_col_name);
-    ovsdb_idl_omit_alert(idl, &ovsrec_power_supply_col_name);
+    powerd_poll_forget(psu);
+    if (psu->status == PSU_STATUS_OK) {
+        subsystem->n_psus_ok--;
+    }
+    if (psu->settling) {
+        subsystem->n_settling--;
+    }
+    if (psu->hotswap_publish && hotswap_pending > 0) {
+        hotswap_pending--;
+    }
+    powerd_shm_free(psu->shm_id);
+    /* delete the psu_data entry */
+    shash_find_and_delete(&psu_data, psu->name);
+    /* delete the subsystem entry */
+    shash_find_and_delete(&subsystem->subsystem_psus, psu->name);
+    /* free the allocated data */
+    free(psu->name);
+    free(psu);
+}
 
-    ovsdb_idl_add_table(idl, &ovsrec_table_subsystem);
-    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_name);
-    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_power_supplies);
-    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_power_supplies);
-    ovsdb_idl_add_column(idl, &ovsrec_subsystem_col_hw_desc_dir);
-    ovsdb_idl_omit_alert(idl, &ovsrec_subsystem_col_hw_desc_dir);
+/* delete a subsystem and all of its psus */
+static void
+powerd_drop_subsystem(struct shash_node *node)
+{
+    struct locl_subsystem *subsystem = node->data;
+    struct shash_node *psu_node, *psu_next;
 
-    unixctl_command_register("ops-powerd/dump", "", 0, 0,
-                             powerd_unixctl_dump, NULL);
-    unixctl_command_register("ops-powerd/test", "psu state", 2, 2,
-                             powerd_unixctl_test, NULL);
+    SHASH_FOR_EACH_SAFE(psu_node, psu_next, &subsystem->subsystem_psus) {
+        powerd_psu_destroy(psu_node->data);
+    }
+    shash_destroy(&subsystem->subsystem_psus);
+    powerd_watch_remove(subsystem->name);
+    powerd_desc_unstage(subsystem->desc_work_dir);
+    free(subsystem->desc_work_dir);
+    free(subsystem->desc_dir);
+    free(subsystem->name);
+    free(subsystem);
+
+    /* delete the subsystem dictionary entry */
+    shash_delete(&subsystem_data, node);
+
+    /* OPS_TODO: need to remove subsystem yaml data */
+}
 
-    retval = event_log_init("POWER");
-    if(retval < 0) {
-        VLOG_ERR("Event log initialization failed for POWER");
+/* watch the description directory of a subsystem again if it went away
+   and is back; its files may have changed meanwhile, so all are taken as
+   changed */
+static void
+powerd_rewatch_subsystem(struct locl_subsystem *subsystem)
+{
+    if (powerd_watch_add(subsystem->name, subsystem->desc_dir)) {
+        subsystem->desc_changes |= DESC_DEVICES | DESC_POWER | DESC_THERMAL;
+        subsystem->desc_reload_at = time_msec() + DESC_DEBOUNCE;
     }
 }
 
-/* pre-exit shutdown processing */
+/* note a change to a hardware description file, reported by inotify */
 static void
-powerd_exit(void)
+powerd_desc_changed(const char *subsystem_name, const char *file)
 {
-    ovsdb_idl_destroy(idl);
+    struct locl_subsystem *subsystem;
+    unsigned int change;
+
+    if (!strcmp(file, DESC_DEVICES_FILE)) {
+        change = DESC_DEVICES;
+    } else if (!strcmp(file, DESC_POWER_FILE)) {
+        change = DESC_POWER;
+    } else if (!strcmp(file, DESC_THERMAL_FILE)) {
+        change = DESC_THERMAL;
+    } else {
+        return;
+    }
+
+    subsystem = shash_find_data(&subsystem_data, subsystem_name);
+    if (subsystem == NULL) {
+        return;
+    }
+
+    /* an editor or installer touches a file several times in a row, so
+       the reload waits until the files have been quiet for a while */
+    VLOG_DBG("subsystem %s: %s changed", subsystem_name, file);
+    subsystem->desc_changes |= change;
+    subsystem->desc_reload_at = time_msec() + DESC_DEBOUNCE;
 }
 
-/* poll every psu for new state */
+/************************************************************************//**
+ * Function that reloads the hardware description of a subsystem whose
+ * files have changed.
+ *
+ * Only the files that changed are parsed again, in place on the handle
+ * that already holds the subsystem, and the psus are then matched with
+ * the new power description by name. Psus
+ * that are kept continue with their state, and are read right away if
+ * their status bits were edited; new psus are added as at discovery, and
+ * psus no longer described are deleted, their rows going with them. A
+ * description that fails to parse is dealt with as at discovery: the
+ * subsystem is no longer managed and its rows are marked unknown until
+ * the files change again.
+ *
+ * Queued requests point into the parsed description, so the reload waits
+ * until the subsystem has none.
+ ***************************************************************************/
 static void
-powerd_run__(void)
+powerd_reload_subsystem_desc(struct shash_node *node)
 {
-    struct ovsdb_idl_txn *txn;
-    const struct ovsrec_power_supply *cfg;
-    const struct ovsrec_daemon *db_daemon;
-    struct shash_node *node;
-    struct shash_node *psu_node;
-    struct locl_psu *psu;
-    bool change = false;
+    struct locl_subsystem *subsystem = node->data;
+    const struct ovsrec_subsystem *ovsrec_subsys;
+    struct shash_node *psu_node, *psu_next;
+    struct sset names;
+    unsigned int changes;
+    int added = 0, removed = 0, changed = 0;
+    int psu_count = 0;
+    int rc = -1;
+    int idx;
 
-    SHASH_FOR_EACH(node, &subsystem_data) {
-        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
-        if (!subsystem->valid) {
-            continue;
+    if (!powerd_i2c_idle(subsystem->name)) {
+        subsystem->desc_reload_at = time_msec() + DESC_DEBOUNCE;
+        return;
+    }
+    powerd_rewatch_subsystem(subsystem);
+    changes = subsystem->desc_changes;
+    subsystem->desc_changes = 0;
+    subsystem->desc_reload_at = 0;
+
+    if (subsystem->valid) {
+        rc = 0;
+        /* a file added since staging has no link there yet */
+        if (subsystem->desc_work_dir != NULL) {
+            int error = powerd_desc_restage(subsystem->desc_dir,
+                                            subsystem->desc_work_dir);
+
+            if (error) {
+                VLOG_ERR("Unable to stage subsystem %s description (in %s): "
+                         "%s", subsystem->name, subsystem->desc_dir,
+                         ovs_strerror(error));
+                rc = -1;
+            }
         }
-        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
-            psu = (struct locl_psu *)psu_node->data;
-            powerd_read_psu(psu);
+        powerd_i2c_desc_lock();
+        if (rc == 0 && (changes & DESC_POWER)) {
+            rc = yaml_parse_psus(yaml_handle, subsystem->name);
+        }
+        /* a pruned devices file depends on the power description */
+        if (rc == 0 && ((changes & DESC_DEVICES) ||
+                        ((changes & DESC_POWER) &&
+                         subsystem->desc_work_dir != NULL))) {
+            rc = powerd_parse_devices(subsystem, subsystem->desc_dir);
         }
+        if (rc == 0 && (changes & DESC_THERMAL)) {
+            powerd_parse_thermal(subsystem);
+        }
+        powerd_i2c_desc_unlock();
+        if (rc == 0) {
+            psu_count = yaml_get_psu_count(yaml_handle, subsystem->name);
+        }
+    }
+    if (psu_count <= 0) {
+        /* the next reconfigure pass adds the subsystem again */
+        VLOG_INFO("subsystem %s: hardware description changed, loading "
+                  "it again", subsystem->name);
+        powerd_drop_subsystem(node);
+        bootstrap_pending = true;
+        return;
     }
 
-    txn = ovsdb_idl_txn_create(idl);
-    OVSREC_POWER_SUPPLY_FOR_EACH(cfg, idl) {
-        const char *status;
-        node = shash_find(&psu_data, cfg->name);
-        if (node == NULL) {
-            VLOG_WARN("unable to find matching psu for %s", cfg->name);
-            ovsrec_power_supply_set_status(
-                cfg,
-                psu_status_to_string(PSU_STATUS_OK));
-            change = true;
+    /* keep, or add, the psus of the new description */
+    sset_init(&names);
+    for (idx = 0; idx < psu_count; idx++) {
+        const YamlPsu *yaml_psu = yaml_get_psu(yaml_handle, subsystem->name,
+                                               idx);
+        struct locl_psu *psu;
+        char *psu_name;
+
+        if (yaml_psu == NULL) {
             continue;
         }
-        psu = (struct locl_psu *)node->data;
-
-        /* note: only apply changes - don't blindly set data */
-
-        /* calculate and set status */
-        status = psu_status_to_string(psu->status);
-        if (strcmp(status, cfg->status) != 0) {
-            ovsrec_power_supply_set_status(cfg, status);
-            change = true;
+        psu_name = xasprintf("%s-%d", subsystem->name, yaml_psu->number);
+        psu = shash_find_data(&subsystem->subsystem_psus, psu_name);
+        if (psu == NULL) {
+            psu = powerd_psu_create(subsystem, yaml_psu);
+            added++;
+        } else {
+            uint32_t hash = powerd_psu_desc_hash(subsystem->name, yaml_psu);
+
+            psu->yaml_psu = yaml_psu;
+            if (hash != psu->desc_hash) {
+                psu->desc_hash = hash;
+                psu->next_poll = time_msec();
+                changed++;
+            }
         }
+        sset_add(&names, psu->name);
+        free(psu_name);
     }
 
-    /* If first time through, set cur_hw = 1 */
-    if (!cur_hw_set) {
-        OVSREC_DAEMON_FOR_EACH(db_daemon, idl) {
-            if (strncmp(db_daemon->name, NAME_IN_DAEMON_TABLE,
-                        strlen(NAME_IN_DAEMON_TABLE)) == 0) {
-                ovsrec_daemon_set_cur_hw(db_daemon, (int64_t) 1);
-                cur_hw_set = true;
-                change = true;
-                break;
-            }
+    /* delete the psus that went away */
+    SHASH_FOR_EACH_SAFE(psu_node, psu_next, &subsystem->subsystem_psus) {
+        if (!sset_contains(&names, psu_node->name)) {
+            VLOG_DBG("Removing psu %s", psu_node->name);
+            powerd_psu_destroy(psu_node->data);
+            removed++;
         }
     }
+    sset_destroy(&names);
 
-    /* if a change was made, execute the transaction */
-    if (change == true) {
-        ovsdb_idl_txn_commit_block(txn);
+    ovsrec_subsys = lookup_subsystem(subsystem->name);
+    if (ovsrec_subsys != NULL) {
+        powerd_set_polling_period(subsystem, ovsrec_subsys);
+    }
+    if (removed) {
+        powerd_update_power_budget(subsystem);
+    }
+
+    /* rewrite the psu references of the Subsystem row, and run a
+       reconfigure pass to drive the LEDs of the new description */
+    if (added || removed) {
+        subsystem->published = false;
+    }
+    bootstrap_pending = true;
+    publish_dirty = true;
+    subsystem->desc_reloads++;
+
+    VLOG_INFO("subsystem %s: reloaded hardware description, %d psus added, "
+              "%d removed, %d changed", subsystem->name, added, removed,
+              changed);
+}
+
+/* reload the changed hardware descriptions whose debounce time is up */
+static void
+powerd_reload_descs(void)
+{
+    struct shash_node *node, *next;
+    long long int now = time_msec();
+
+    powerd_watch_run();
+
+    SHASH_FOR_EACH_SAFE(node, next, &subsystem_data) {
+        struct locl_subsystem *subsystem = node->data;
+
+        if (subsystem->desc_changes != 0 && subsystem->desc_reload_at <= now) {
+            powerd_reload_subsystem_desc(node);
+        }
     }
-    ovsdb_idl_txn_destroy(txn);
 }
 
 /* lookup a local subsystem structure */
@@ -560,6 +2733,7 @@ get_subsystem(const struct ovsrec_subsystem *ovsrec_subsys)
         result = add_subsystem(ovsrec_subsys);
     } else {
         result = (struct locl_subsystem *)ptr;
+        powerd_rewatch_subsystem(result);
         if (!result->valid) {
             result = NULL;
         }
@@ -590,109 +2764,362 @@ static void
 powerd_remove_unmarked_subsystems(void)
 {
     struct shash_node *node, *next;
-    struct shash_node *temp_node, *temp_next;
-    struct shash_node *global_node;
 
     SHASH_FOR_EACH_SAFE(node, next, &subsystem_data) {
         struct locl_subsystem *subsystem = node->data;
 
         if (subsystem->marked == false) {
             /* also, delete all psus in the subsystem */
-            SHASH_FOR_EACH_SAFE(temp_node, temp_next, &subsystem->subsystem_psus) {
-                struct locl_psu *temp = (struct locl_psu *)temp_node->data;
-                /* delete the psu_data entry */
-                global_node = shash_find(&psu_data, temp->name);
-                shash_delete(&psu_data, global_node);
-                /* delete the subsystem entry */
-                shash_delete(&subsystem->subsystem_psus, temp_node);
-                /* free the allocated data */
-                free(temp->name);
-                free(temp);
-            }
-            free(subsystem->name);
-            free(subsystem);
-
-            /* delete the subsystem dictionary entry */
-            shash_delete(&subsystem_data, node);
-
-            /* OPS_TODO: need to remove subsystem yaml data */
+            powerd_drop_subsystem(node);
         }
     }
 }
 
 /* process any changes to cached data */
 static void
-powerd_reconfigure(struct ovsdb_idl *idl)
+powerd_reconfigure(struct ovsdb_idl *idl, bool active)
 {
     const struct ovsrec_subsystem *subsys;
     unsigned int new_idl_seqno = ovsdb_idl_get_seqno(idl);
 
     COVERAGE_INC(powerd_reconfigure);
 
-    if (new_idl_seqno == idl_seqno) {
+    if (new_idl_seqno == idl_seqno && !bootstrap_pending) {
         return;
     }
 
     idl_seqno = new_idl_seqno;
+    POWERD_PROBE1(reconfigure, new_idl_seqno);
 
     /* handle any added or deleted subsystems */
     powerd_unmark_subsystems();
 
     OVSREC_SUBSYSTEM_FOR_EACH(subsys, idl) {
         struct locl_subsystem *subsystem;
+
+        /* subsystems of other shards are left unmarked, so they are
+           dropped here if they were just reassigned */
+        if (!powerd_shard_owns(subsys)) {
+            continue;
+        }
         /* get_subsystem will create a new one if it was added */
         subsystem = get_subsystem(subsys);
         if (subsystem == NULL) {
             continue;
         }
-        powerd_set_psuleds(subsystem);
+        powerd_set_polling_period(subsystem, subsys);
+        powerd_set_power_config(subsystem, subsys);
+        if (active) {
+            powerd_set_psuleds(subsystem);
+        }
         subsystem->marked = true;
     }
 
     /* remove any subsystems that are no longer present in the db */
     powerd_remove_unmarked_subsystems();
+
+    /* a standby leaves the db alone */
+    if (!active) {
+        return;
+    }
+
+    /* add the rows of new subsystems to the db */
+    powerd_bootstrap_subsystems();
+
+    /* deal with rows left behind by removed subsystems and psus */
+    powerd_reconcile_orphans();
+}
+
+/* count a wakeup, rolling the rate window over once it is complete */
+static void
+powerd_idle_account(void)
+{
+    long long int now = time_msec();
+    long long int elapsed;
+
+    idle_stats.wakeups++;
+    if (idle_stats.start == 0) {
+        idle_stats.start = idle_stats.window_start = now;
+        idle_stats.window_cpu = powerd_cpu_msec();
+        return;
+    }
+
+    elapsed = now - idle_stats.window_start;
+    if (elapsed >= IDLE_WINDOW) {
+        long long int cpu = powerd_cpu_msec();
+
+        idle_stats.wakeups_per_min = (idle_stats.wakeups
+                                      - idle_stats.window_wakeups)
+                                     * 60000.0 / elapsed;
+        idle_stats.cpu_ms_per_hour = (cpu - idle_stats.window_cpu)
+                                     * 3600000.0 / elapsed;
+        idle_stats.window_start = now;
+        idle_stats.window_wakeups = idle_stats.wakeups;
+        idle_stats.window_cpu = cpu;
+    }
 }
 
 /* perform all of the per-loop processing */
 static void
 powerd_run(void)
 {
+    powerd_idle_account();
+
+    powerd_profile_phase(PHASE_IDL_RUN);
     ovsdb_idl_run(idl);
 
-    if (ovsdb_idl_is_lock_contended(idl)) {
-        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 1);
+    /* apply results of completed hardware requests */
+    powerd_profile_phase(PHASE_I2C);
+    powerd_i2c_run();
 
-        VLOG_ERR_RL(&rl, "another ops-powerd process is running, "
-                    "disabling this process until it goes away");
+    /* write out the register accesses recorded since the last pass */
+    powerd_trace_run();
 
-        return;
-    } else if (!ovsdb_idl_has_lock(idl)) {
+    /* answer metrics scrapes; the socket is only open while active */
+    powerd_profile_phase(PHASE_METRICS);
+    powerd_metrics_run();
+
+    /* pick up edited hardware descriptions; a standby follows them too,
+       so that its psus match those of the active instance */
+    powerd_profile_phase(PHASE_RECONFIGURE);
+    powerd_reload_descs();
+
+    if (!ovsdb_idl_has_lock(idl)) {
+        if (ovsdb_idl_is_lock_contended(idl)) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 60);
+
+            VLOG_INFO_RL(&rl, "another ops-powerd process is running, "
+                         "standing by until it goes away");
+            standby.contended = true;
+        }
+
+        /* keep discovery and psu state warm for a takeover, and leave
+           the snapshot and the metrics socket to the active instance */
+        standby.standby = true;
+        powerd_shm_writer_close();
+        powerd_metrics_close();
+        shm_failed = false;
+        powerd_profile_phase(PHASE_RECONFIGURE);
+        powerd_reconfigure(idl, false);
+        if (mirror_dirty || mirror_seqno != ovsdb_idl_get_seqno(idl)) {
+            powerd_mirror_status();
+        }
+        daemonize_complete();
         return;
     }
 
+    if (standby.standby) {
+        standby.standby = false;
+        if (standby.contended) {
+            standby.acquired = time_msec();
+        }
+        /* catch up with what the previous owner published, then force a
+           reconfigure pass to drive LEDs and write rows */
+        powerd_mirror_status();
+        bootstrap_pending = true;
+        publish_dirty = true;
+    }
+
     /* handle changes to cache */
-    powerd_reconfigure(idl);
+    powerd_profile_phase(PHASE_RECONFIGURE);
+    powerd_reconfigure(idl, true);
+    powerd_shm_activate();
+    powerd_metrics_open();
     /* poll all psus and report changes into db */
+    powerd_profile_phase(PHASE_RUN);
     powerd_run__();
 
+    if (standby.acquired != 0) {
+        standby.last_latency = time_msec() - standby.acquired;
+        standby.max_latency = MAX(standby.max_latency, standby.last_latency);
+        standby.takeovers++;
+        standby.acquired = 0;
+        standby.contended = false;
+        VLOG_INFO("took over from another ops-powerd process, publishing "
+                  "after %lld ms", standby.last_latency);
+    }
+
     daemonize_complete();
     vlog_enable_async();
     VLOG_INFO_ONCE("%s (OpenSwitch powerd) %s", program_name, VERSION);
 }
 
-/* initialize periodic poll of psus */
+/* find the time (ms) at which the next psu read is due */
+static long long int
+powerd_next_poll(void)
+{
+    struct shash_node *node;
+    struct shash_node *psu_node;
+    long long int next = LLONG_MAX;
+
+    if (poll_queue_head != NULL) {
+        return(poll_resume);
+    }
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+        if (!subsystem->valid) {
+            continue;
+        }
+        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
+            struct locl_psu *psu = (struct locl_psu *)psu_node->data;
+            if (psu->next_poll < next) {
+                next = psu->next_poll;
+            }
+        }
+    }
+
+    return(next);
+}
+
+/* sleep until the db changes or the next psu is due for polling */
 static void
 powerd_wait(void)
 {
+    struct shash_node *node;
+    long long int next;
+
     ovsdb_idl_wait(idl);
-    poll_timer_wait(POLLING_PERIOD * MSEC_PER_SEC);
+    powerd_i2c_wait();
+    powerd_metrics_wait();
+    powerd_watch_wait();
+
+    /* reload changed hardware descriptions once they are quiet */
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        const struct locl_subsystem *subsystem = node->data;
+
+        if (subsystem->desc_changes != 0) {
+            poll_timer_wait_until(subsystem->desc_reload_at);
+        }
+    }
+
+    /* nothing is polled until we hold the lock */
+    if (!ovsdb_idl_has_lock(idl)) {
+        return;
+    }
+
+    next = MIN(powerd_next_poll(), powerd_scenario_next());
+    if (next != LLONG_MAX) {
+        poll_timer_wait_until(next);
+    }
+
+    /* retry adding psu rows that failed to commit */
+    if (bootstrap_pending) {
+        poll_timer_wait(BOOTSTRAP_RETRY);
+    }
 }
 
 static void
 powerd_unixctl_dump(struct unixctl_conn *conn, int argc OVS_UNUSED,
                           const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
 {
-    unixctl_command_reply_error(conn, "Nothing to dump :)");
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    struct shash_node *node;
+    struct shash_node *psu_node;
+    long long int now = time_msec();
+    size_t i;
+
+    SHASH_FOR_EACH(node, &subsystem_data) {
+        struct locl_subsystem *subsystem = (struct locl_subsystem *)node->data;
+
+        ds_put_format(&ds, "Subsystem: %s%s\n", subsystem->name,
+                      subsystem->valid ? "" : " (not managed)");
+        if (!subsystem->valid) {
+            continue;
+        }
+        ds_put_format(&ds, "    polling period: %d ms (%s)\n",
+                      subsystem->polling_period, subsystem->polling_source);
+        ds_put_format(&ds, "    hw description: parsed in %lld us, "
+                      "%lld bytes of heap", subsystem->desc_parse_usec,
+                      subsystem->desc_heap_bytes);
+        if (subsystem->desc_prune.devices_total != 0) {
+            ds_put_format(&ds, ", %d of %d devices (%zu of %zu bytes)",
+                          subsystem->desc_prune.devices_kept,
+                          subsystem->desc_prune.devices_total,
+                          subsystem->desc_prune.bytes_kept,
+                          subsystem->desc_prune.bytes_total);
+        } else {
+            ds_put_cstr(&ds, ", all devices");
+        }
+        ds_put_format(&ds, ", %u reloads%s\n", subsystem->desc_reloads,
+                      subsystem->desc_changes ? ", reload pending" : "");
+        ds_put_format(&ds, "    power: %d of %zu psus ok, %d required, "
+                      "capacity %d W, redundancy %s\n",
+                      subsystem->n_psus_ok,
+                      shash_count(&subsystem->subsystem_psus),
+                      subsystem->psus_required,
+                      subsystem->n_psus_ok * subsystem->psu_rated_watts,
+                      power_redundancy_str[subsystem->redundancy]);
+        SHASH_FOR_EACH(psu_node, &subsystem->subsystem_psus) {
+            struct locl_psu *psu = (struct locl_psu *)psu_node->data;
+
+            ds_put_format(&ds, "    psu %s: %s, next poll in %lld ms%s\n",
+                          psu->name, psu_status_to_string(psu->status),
+                          MAX(psu->next_poll - now, 0),
+                          psu->poll_queued ? " (queued)" : "");
+            if (psu->last_change != 0) {
+                ds_put_format(&ds, "        %llu transitions, in state "
+                              "for %lld s\n", psu->n_transitions,
+                              (time_wall_msec() - psu->last_change)
+                              / MSEC_PER_SEC);
+            }
+            ds_put_format(&ds, "        flap rate %.3f, fail rate %.3f, "
+                          "input var %.3f, output var %.3f, degraded %s\n",
+                          psu->flap_stat.mean, psu->fail_stat.mean,
+                          psu->input_stat.var, psu->output_stat.var,
+                          psu->degraded ? psu->degraded_reason : "no");
+        }
+    }
+
+    if (ds.length == 0) {
+        ds_put_cstr(&ds, "No subsystems\n");
+    }
+
+    if (shard_count != 0) {
+        ds_put_format(&ds, "Shard: %d of %d\n", shard_id, shard_count);
+    }
+    ds_put_format(&ds, "Role: %s, takeovers %u, takeover latency "
+                  "last/max %lld/%lld ms\n",
+                  standby.standby ? "standby" : "active", standby.takeovers,
+                  standby.last_latency, standby.max_latency);
+    ds_put_format(&ds, "Shared memory snapshot: %s\n",
+                  powerd_shm_writer_is_open() ? "written" : "not written");
+
+    ds_put_format(&ds, "Poll budget: ");
+    if (poll_budget > 0) {
+        ds_put_format(&ds, "%d ms per bus per wakeup\n", poll_budget);
+    } else {
+        ds_put_format(&ds, "unlimited\n");
+    }
+    ds_put_format(&ds, "    wakeups: %llu, psu reads: %llu\n",
+                  poll_stats.wakeups, poll_stats.reads);
+    ds_put_format(&ds, "    budget overruns: %llu, reads carried over: %llu\n",
+                  poll_stats.overruns, poll_stats.carried);
+
+    ds_put_format(&ds, "Idle: %llu wakeups, %llu without publishing, "
+                  "timer slack %d ms\n", idle_stats.wakeups,
+                  idle_stats.skipped, timer_slack);
+    ds_put_format(&ds, "    last %d s: %.1f wakeups/min, "
+                  "%.1f ms cpu/hour\n", IDLE_WINDOW / MSEC_PER_SEC,
+                  idle_stats.wakeups_per_min, idle_stats.cpu_ms_per_hour);
+
+    ds_put_format(&ds, "Hot-swap: %llu insertions, %llu bounced, "
+                  "slowest %lld ms\n", hotswap_stats.insertions,
+                  hotswap_stats.bounces, hotswap_stats.max);
+    for (i = 0; i < HOTSWAP_BUCKETS; i++) {
+        if (i < ARRAY_SIZE(hotswap_bounds)) {
+            ds_put_format(&ds, "    < %4d ms: %llu\n", hotswap_bounds[i],
+                          hotswap_stats.hist[i]);
+        } else {
+            ds_put_format(&ds, "    >=%4d ms: %llu\n", hotswap_bounds[i - 1],
+                          hotswap_stats.hist[i]);
+        }
+    }
+
+    powerd_trace_dump(&ds);
+    powerd_i2c_dump(&ds);
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
 }
 
 
@@ -732,13 +3159,16 @@ main(int argc, char *argv[])
     exiting = false;
     while (!exiting) {
         powerd_run();
+        powerd_profile_phase(PHASE_UNIXCTL);
         unixctl_server_run(unixctl);
 
+        powerd_profile_phase(PHASE_WAIT);
         powerd_wait();
         unixctl_server_wait(unixctl);
         if (exiting) {
             poll_immediate_wake();
         }
+        powerd_profile_idle();
         poll_block();
     }
     powerd_exit();
@@ -753,6 +3183,17 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
     enum {
         OPT_PEER_CA_CERT = UCHAR_MAX + 1,
         OPT_UNIXCTL,
+        OPT_POLL_BUDGET,
+        OPT_METRICS,
+        OPT_SHARD,
+        OPT_RECORD,
+        OPT_REPLAY,
+        OPT_REPLAY_FAST,
+        OPT_WATCHDOG,
+        OPT_WATCHDOG_ABORT,
+        OPT_TIMER_SLACK,
+        OPT_SINGLE_READS,
+        OPT_PARSE_ALL_DEVICES,
         VLOG_OPTION_ENUMS,
         OPT_BOOTSTRAP_CA_CERT,
         OPT_ENABLE_DUMMY,
@@ -764,6 +3205,17 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
         {"help",        no_argument, NULL, 'h'},
         {"version",     no_argument, NULL, 'V'},
         {"unixctl",     required_argument, NULL, OPT_UNIXCTL},
+        {"poll-budget", required_argument, NULL, OPT_POLL_BUDGET},
+        {"metrics",     required_argument, NULL, OPT_METRICS},
+        {"shard",       required_argument, NULL, OPT_SHARD},
+        {"record",      required_argument, NULL, OPT_RECORD},
+        {"replay",      required_argument, NULL, OPT_REPLAY},
+        {"replay-fast", no_argument, NULL, OPT_REPLAY_FAST},
+        {"watchdog",    required_argument, NULL, OPT_WATCHDOG},
+        {"watchdog-abort", no_argument, NULL, OPT_WATCHDOG_ABORT},
+        {"timer-slack", required_argument, NULL, OPT_TIMER_SLACK},
+        {"single-reads", no_argument, NULL, OPT_SINGLE_READS},
+        {"parse-all-devices", no_argument, NULL, OPT_PARSE_ALL_DEVICES},
         DAEMON_LONG_OPTIONS,
         VLOG_LONG_OPTIONS,
         STREAM_SSL_LONG_OPTIONS,
@@ -793,6 +3245,71 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
             *unixctl_pathp = optarg;
             break;
 
+        case OPT_POLL_BUDGET:
+            if (!str_to_int(optarg, 10, &poll_budget) || poll_budget < 0) {
+                VLOG_FATAL("--poll-budget argument must be a non-negative "
+                           "number of milliseconds");
+            }
+            break;
+
+        case OPT_METRICS:
+            metrics_path = xstrdup(optarg);
+            break;
+
+        case OPT_SHARD: {
+            int n = 0;
+
+            if (sscanf(optarg, "%d/%d%n", &shard_id, &shard_count, &n) != 2
+                || optarg[n] != '\0' || shard_count < 1
+                || shard_id < 0 || shard_id >= shard_count) {
+                VLOG_FATAL("--shard argument must be ID/COUNT, "
+                           "with 0 <= ID < COUNT");
+            }
+            break;
+        }
+
+        case OPT_RECORD:
+            record_path = xstrdup(optarg);
+            break;
+
+        case OPT_REPLAY:
+            replay_path = xstrdup(optarg);
+            break;
+
+        case OPT_REPLAY_FAST:
+            replay_fast = true;
+            break;
+
+        case OPT_WATCHDOG: {
+            int deadline;
+
+            if (!str_to_int(optarg, 10, &deadline) || deadline < 0) {
+                VLOG_FATAL("--watchdog argument must be a non-negative "
+                           "number of milliseconds");
+            }
+            watchdog_deadline = deadline;
+            break;
+        }
+
+        case OPT_WATCHDOG_ABORT:
+            watchdog_abort = true;
+            break;
+
+        case OPT_TIMER_SLACK:
+            if (!str_to_int(optarg, 10, &timer_slack) || timer_slack < 0) {
+                VLOG_FATAL("--timer-slack argument must be a non-negative "
+                           "number of milliseconds");
+            }
+            break;
+
+        case OPT_SINGLE_READS:
+            single_reads = true;
+            break;
+
+        case OPT_PARSE_ALL_DEVICES:
+            parse_all_devices = true;
+            break;
+
         VLOG_OPTION_HANDLERS
         DAEMON_OPTION_HANDLERS
         STREAM_SSL_OPTION_HANDLERS
@@ -814,6 +3331,24 @@ parse_options(int argc, char *argv[], char **unixctl_pathp)
     }
     free(short_options);
 
+    if (record_path != NULL && replay_path != NULL) {
+        VLOG_FATAL("--record and --replay are mutually exclusive");
+    }
+    if (replay_fast && replay_path == NULL) {
+        VLOG_FATAL("--replay-fast requires --replay");
+    }
+    if (watchdog_abort && watchdog_deadline == 0) {
+        VLOG_FATAL("--watchdog-abort requires --watchdog");
+    }
+
+    if (metrics_path == NULL && shard_count != 0) {
+        metrics_path = xasprintf("%s/%s.metrics.shard%d", ovs_rundir(),
+                                 program_name, shard_id);
+    } else if (metrics_path == NULL) {
+        metrics_path = xasprintf("%s/%s.metrics", ovs_rundir(),
+                                 program_name);
+    }
+
     argc -= optind;
     argv += optind;
 
@@ -842,9 +3377,30 @@ usage(void)
     daemon_usage();
     vlog_usage();
     printf("\nOther options:\n"
+           "  --poll-budget=MSEC      i2c time budget per bus per wakeup\n"
+           "                          (0: unlimited)\n"
+           "  --shard=ID/COUNT        serve only the subsystems of shard ID\n"
+           "                          out of COUNT\n"
+           "  --metrics=SOCKET        serve OpenMetrics on unix SOCKET\n"
+           "                          (default: %s/%s.metrics, with\n"
+           "                          .shardID appended with --shard)\n"
+           "  --record=FILE           record every register access to FILE\n"
+           "  --replay=FILE           answer register accesses from a trace\n"
+           "                          recorded with --record\n"
+           "  --replay-fast           replay without the recorded timing\n"
+           "  --watchdog=MSEC         report main loop iterations longer\n"
+           "                          than MSEC (0: disabled)\n"
+           "  --watchdog-abort        with --watchdog, abort on a stall\n"
+           "  --timer-slack=MSEC      let wakeups be delayed by up to MSEC\n"
+           "                          to coalesce them (0: kernel default)\n"
+           "  --single-reads          read each register bit on its own\n"
+           "                          instead of once per register\n"
+           "  --parse-all-devices     parse every device of the devices\n"
+           "                          files, not just those of the psus\n"
            "  --unixctl=SOCKET        override default control socket name\n"
            "  -h, --help              display this help message\n"
-           "  -V, --version           display version information\n");
+           "  -V, --version           display version information\n",
+           ovs_rundir(), program_name);
     exit(EXIT_SUCCESS);
 }
 
@@ -0,0 +1,643 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for the pruned hardware descriptions of ops-powerd
+ ***************************************************************************/
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "dirs.h"
+#include "sset.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_desc.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_desc);
+
+/* one entry of the devices sequence: bytes [start, end) of the file */
+struct desc_item {
+    size_t start;
+    size_t end;
+    int key_indent;        /* column of the keys of the entry */
+    char *name;            /* value of its "name" key, or NULL */
+    struct sset deps;      /* devices named by "device" keys within it */
+    bool keep;
+};
+
+/* the devices file cut into the part before the sequence, its entries,
+   and the part after it */
+struct desc_split {
+    size_t seq_start;
+    size_t seq_end;
+    struct desc_item *items;
+    size_t n_items;
+    size_t allocated;
+};
+
+static size_t
+desc_line_end(const char *buf, size_t len, size_t pos)
+{
+    const char *nl = memchr(buf + pos, '\n', len - pos);
+
+    return(nl != NULL ? nl - buf + 1 : len);
+}
+
+static bool
+desc_blank(const char *p, const char *end)
+{
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    return(p == end || *p == '\n' || *p == '\r' || *p == '#');
+}
+
+/* if [p, end) starts with "key:", return the value after it, trimmed of
+   blanks, a trailing comment and quotes, else NULL */
+static char *
+desc_key_value(const char *p, const char *end, const char *key)
+{
+    size_t klen = strlen(key);
+    const char *v, *e;
+
+    if (end - p <= klen || memcmp(p, key, klen) || p[klen] != ':') {
+        return(NULL);
+    }
+
+    v = p + klen + 1;
+    while (v < end && *v == ' ') {
+        v++;
+    }
+    for (e = v; e < end && *e != '\n' && *e != '\r'; e++) {
+        if (*e == '#' && e > v && e[-1] == ' ') {
+            break;
+        }
+    }
+    while (e > v && e[-1] == ' ') {
+        e--;
+    }
+    if (e - v >= 2 && (*v == '"' || *v == '\'') && e[-1] == *v) {
+        v++;
+        e--;
+    }
+
+    return(xmemdup0(v, e - v));
+}
+
+/* YAML anchors, aliases and merge keys can make an entry depend on
+   another one in ways not visible here */
+static bool
+desc_has_references(const char *p, const char *end)
+{
+    for (; p < end && *p != '\n' && *p != '#'; p++) {
+        if (*p == '&' || *p == '*' || (*p == '<' && p + 1 < end
+                                        && p[1] == '<')) {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+/* a flow collection, "{...}" or "[...]", can hold "device" keys that are
+   not at the start of a line */
+static bool
+desc_has_flow(const char *p, const char *end)
+{
+    for (; p < end && *p != '\n' && *p != '#'; p++) {
+        if (*p == '{' || *p == '[') {
+            return(true);
+        }
+    }
+    return(false);
+}
+
+static void
+desc_split_destroy(struct desc_split *split)
+{
+    size_t i;
+
+    for (i = 0; i < split->n_items; i++) {
+        free(split->items[i].name);
+        sset_destroy(&split->items[i].deps);
+    }
+    free(split->items);
+}
+
+/************************************************************************//**
+ * Function that cuts a devices file into the entries of its top level
+ * "devices" sequence, in block style, noting the name of each entry and
+ * the devices it refers to with "device" keys, such as the muxes that
+ * have to be set up to reach it.
+ *
+ * Returns: 0 on success, else -1 if the file does not have that layout,
+ *          uses anchors or aliases, or has flow collections in its
+ *          entries, and cannot be pruned
+ ***************************************************************************/
+static int
+desc_split(const char *buf, size_t len, struct desc_split *split)
+{
+    struct desc_item *cur = NULL;
+    int seq_indent = -1;
+    int key_indent = -1;
+    size_t pos, next;
+
+    memset(split, 0, sizeof *split);
+
+    /* find the "devices:" key */
+    for (pos = 0; pos < len; pos = next) {
+        const char *line = buf + pos;
+        const char *end;
+        char *value;
+
+        next = desc_line_end(buf, len, pos);
+        end = buf + next;
+        if (desc_blank(line, end)) {
+            continue;
+        }
+        if (desc_has_references(line, end)) {
+            return(-1);
+        }
+        while (line < end && *line == ' ') {
+            line++;
+        }
+        value = desc_key_value(line, end, "devices");
+        if (value != NULL) {
+            bool block = (*value == '\0');
+
+            free(value);
+            if (!block) {
+                return(-1);
+            }
+            key_indent = line - (buf + pos);
+            pos = next;
+            break;
+        }
+    }
+    if (key_indent < 0) {
+        return(-1);
+    }
+
+    split->seq_start = split->seq_end = pos;
+    for (; pos < len; pos = next) {
+        const char *line = buf + pos;
+        const char *end;
+        const char *c;
+        bool item;
+        int indent;
+        char *value;
+
+        next = desc_line_end(buf, len, pos);
+        end = buf + next;
+        if (desc_blank(line, end)) {
+            continue;
+        }
+        if (desc_has_references(line, end)) {
+            desc_split_destroy(split);
+            return(-1);
+        }
+
+        for (c = line; c < end && *c == ' '; c++) {
+            continue;
+        }
+        indent = c - line;
+        item = (*c == '-' && (c + 1 == end || c[1] == ' ' || c[1] == '\n'
+                              || c[1] == '\r'));
+
+        if (seq_indent < 0) {
+            if (!item || indent < key_indent) {
+                desc_split_destroy(split);
+                return(-1);
+            }
+            seq_indent = indent;
+            split->seq_start = pos;
+        }
+        if (indent < seq_indent || (indent == seq_indent && !item)) {
+            break;
+        }
+        if (desc_has_flow(c, end)) {
+            desc_split_destroy(split);
+            return(-1);
+        }
+
+        /* the keys of an entry follow its "- " */
+        while (*c == '-' && c + 1 < end && c[1] == ' ') {
+            for (c++; c < end && *c == ' '; c++) {
+                continue;
+            }
+        }
+
+        if (indent == seq_indent && item) {
+            if (cur != NULL) {
+                cur->end = pos;
+            }
+            if (split->n_items >= split->allocated) {
+                split->items = x2nrealloc(split->items, &split->allocated,
+                                          sizeof *split->items);
+            }
+            cur = &split->items[split->n_items++];
+            memset(cur, 0, sizeof *cur);
+            cur->start = pos;
+            cur->key_indent = c - line;
+            sset_init(&cur->deps);
+        }
+
+        if (c - line == cur->key_indent && cur->name == NULL
+            && (value = desc_key_value(c, end, "name")) != NULL) {
+            cur->name = value;
+        } else if ((value = desc_key_value(c, end, "device")) != NULL) {
+            sset_add(&cur->deps, value);
+            free(value);
+        }
+    }
+
+    split->seq_end = pos;
+    if (cur != NULL) {
+        cur->end = pos;
+    }
+    return(0);
+}
+
+/* read a whole file; returns 0 or an errno value */
+static int
+desc_read(const char *file, char **bufp, size_t *lenp)
+{
+    FILE *stream = fopen(file, "r");
+    size_t allocated = 4096;
+    size_t len = 0;
+    char *buf;
+
+    if (stream == NULL) {
+        return(errno);
+    }
+
+    buf = xmalloc(allocated);
+    for (;;) {
+        size_t n = fread(buf + len, 1, allocated - len, stream);
+
+        len += n;
+        if (len < allocated) {
+            break;
+        }
+        buf = x2nrealloc(buf, &allocated, 1);
+    }
+    if (ferror(stream)) {
+        int error = errno;
+
+        fclose(stream);
+        free(buf);
+        return(error);
+    }
+    fclose(stream);
+
+    *bufp = buf;
+    *lenp = len;
+    return(0);
+}
+
+/************************************************************************//**
+ * Function that writes the devices file of "dir" to "work_dir", keeping
+ * only the entries of the devices named in "devices" and, transitively,
+ * of the devices those refer to.
+ *
+ * If the file cannot be pruned, it is written out unchanged. The file is
+ * replaced atomically, so it can be pruned again while a parse of the
+ * previous one is still possible.
+ *
+ * Returns: 0 on success, else an errno value
+ ***************************************************************************/
+int
+powerd_desc_prune(const char *dir, const char *work_dir,
+                  const struct sset *devices,
+                  struct powerd_desc_prune_stats *stats)
+{
+    char *src = xasprintf("%s/%s", dir, DESC_DEVICES_FILE);
+    char *dst = xasprintf("%s/%s", work_dir, DESC_DEVICES_FILE);
+    char *tmp = xasprintf("%s.tmp", dst);
+    struct desc_split split;
+    struct sset keep;
+    FILE *stream = NULL;
+    size_t len, i;
+    char *buf = NULL;
+    bool changed;
+    int error;
+
+    memset(stats, 0, sizeof *stats);
+    error = desc_read(src, &buf, &len);
+    if (error) {
+        goto out;
+    }
+    stats->bytes_total = len;
+
+    stream = fopen(tmp, "w");
+    if (stream == NULL) {
+        error = errno;
+        goto out;
+    }
+
+    if (desc_split(buf, len, &split) != 0) {
+        VLOG_INFO("%s cannot be pruned, using all of it", src);
+        fwrite(buf, 1, len, stream);
+        stats->bytes_kept = len;
+    } else {
+        /* keep the referenced devices and whatever they depend on */
+        sset_clone(&keep, devices);
+        do {
+            changed = false;
+            for (i = 0; i < split.n_items; i++) {
+                struct desc_item *item = &split.items[i];
+                const char *dep;
+
+                if (item->keep || (item->name != NULL
+                                   && !sset_contains(&keep, item->name))) {
+                    continue;
+                }
+                item->keep = true;
+                SSET_FOR_EACH (dep, &item->deps) {
+                    if (!sset_contains(&keep, dep)) {
+                        sset_add(&keep, dep);
+                        changed = true;
+                    }
+                }
+            }
+        } while (changed);
+        sset_destroy(&keep);
+
+        fwrite(buf, 1, split.seq_start, stream);
+        stats->bytes_kept = split.seq_start;
+        for (i = 0; i < split.n_items; i++) {
+            const struct desc_item *item = &split.items[i];
+
+            stats->devices_total++;
+            if (item->keep) {
+                fwrite(buf + item->start, 1, item->end - item->start, stream);
+                stats->bytes_kept += item->end - item->start;
+                stats->devices_kept++;
+            }
+        }
+        fwrite(buf + split.seq_end, 1, len - split.seq_end, stream);
+        stats->bytes_kept += len - split.seq_end;
+        desc_split_destroy(&split);
+    }
+
+    if (ferror(stream)) {
+        error = EIO;
+    }
+    if (fclose(stream) != 0 && !error) {
+        error = errno;
+    }
+    stream = NULL;
+    if (!error && rename(tmp, dst) < 0) {
+        error = errno;
+    }
+
+out:
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    if (error) {
+        unlink(tmp);
+    }
+    free(buf);
+    free(src);
+    free(dst);
+    free(tmp);
+    return(error);
+}
+
+/* staging root of this instance; the pid keeps a standby, or another
+   shard, from touching the files being parsed by the active instance */
+static char *
+desc_root(pid_t pid)
+{
+    return(xasprintf("%s/%s.%ld.desc", ovs_rundir(), program_name,
+                     (long int) pid));
+}
+
+/* remove the entries of a staging directory but "keep", if nonnull */
+static void
+desc_clear(const char *work_dir, const char *keep)
+{
+    struct dirent *de;
+    DIR *d = opendir(work_dir);
+
+    if (d == NULL) {
+        return;
+    }
+    while ((de = readdir(d)) != NULL) {
+        char *path;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")
+            || (keep != NULL && !strcmp(de->d_name, keep))) {
+            continue;
+        }
+        path = xasprintf("%s/%s", work_dir, de->d_name);
+        unlink(path);
+        free(path);
+    }
+    closedir(d);
+}
+
+/* remove the staging root of an instance and its staging directories */
+static void
+desc_remove_root(const char *root)
+{
+    struct dirent *de;
+    DIR *d = opendir(root);
+
+    if (d == NULL) {
+        return;
+    }
+    while ((de = readdir(d)) != NULL) {
+        char *path;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        path = xasprintf("%s/%s", root, de->d_name);
+        powerd_desc_unstage(path);
+        free(path);
+    }
+    closedir(d);
+    rmdir(root);
+}
+
+static void
+desc_remove_root_pid(pid_t pid)
+{
+    char *root = desc_root(pid);
+
+    desc_remove_root(root);
+    free(root);
+}
+
+/************************************************************************//**
+ * Function that removes the staging roots left behind by instances that
+ * are no longer running, such as one that crashed.
+ ***************************************************************************/
+void
+powerd_desc_init(void)
+{
+    char *prefix = xasprintf("%s.", program_name);
+    size_t prefix_len = strlen(prefix);
+    struct dirent *de;
+    DIR *d = opendir(ovs_rundir());
+
+    if (d == NULL) {
+        free(prefix);
+        return;
+    }
+    while ((de = readdir(d)) != NULL) {
+        char *end;
+        long int pid;
+
+        if (strncmp(de->d_name, prefix, prefix_len)) {
+            continue;
+        }
+        pid = strtol(de->d_name + prefix_len, &end, 10);
+        if (end == de->d_name + prefix_len || strcmp(end, ".desc")
+            || pid <= 0 || pid == getpid()
+            || kill(pid, 0) == 0 || errno != ESRCH) {
+            continue;
+        }
+        desc_remove_root_pid((pid_t) pid);
+    }
+    closedir(d);
+    free(prefix);
+}
+
+/* remove the staging root of this instance */
+void
+powerd_desc_exit(void)
+{
+    desc_remove_root_pid(getpid());
+}
+
+/* link every file of "dir" but the devices file into "work_dir", after
+   removing the links already there */
+static int
+desc_link(const char *dir, const char *work_dir)
+{
+    struct dirent *de;
+    int error = 0;
+    DIR *d;
+
+    desc_clear(work_dir, DESC_DEVICES_FILE);
+
+    d = opendir(dir);
+    if (d == NULL) {
+        error = errno;
+        VLOG_WARN("%s: cannot read (%s)", dir, ovs_strerror(error));
+        return(error);
+    }
+    while (!error && (de = readdir(d)) != NULL) {
+        char *src, *dst;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")
+            || !strcmp(de->d_name, DESC_DEVICES_FILE)) {
+            continue;
+        }
+        src = xasprintf("%s/%s", dir, de->d_name);
+        dst = xasprintf("%s/%s", work_dir, de->d_name);
+        if (symlink(src, dst) < 0) {
+            error = errno;
+            VLOG_WARN("%s: cannot link to %s (%s)", dst, src,
+                      ovs_strerror(error));
+        }
+        free(src);
+        free(dst);
+    }
+    closedir(d);
+
+    return(error);
+}
+
+/************************************************************************//**
+ * Function that sets up the staging directory of a subsystem, with links
+ * to every file of its hardware description directory "dir" but the
+ * devices file, which powerd_desc_prune() then writes.
+ *
+ * Returns: the staging directory, to be freed by the caller, or NULL if
+ *          it cannot be set up and "dir" has to be parsed as it is
+ ***************************************************************************/
+char *
+powerd_desc_stage(const char *subsystem, const char *dir)
+{
+    char *root = desc_root(getpid());
+    char *work_dir = NULL;
+    char *name, *p;
+
+    if (mkdir(root, 0755) < 0 && errno != EEXIST) {
+        VLOG_WARN("%s: cannot create (%s)", root, ovs_strerror(errno));
+        goto out;
+    }
+
+    name = xstrdup(subsystem);
+    for (p = name; *p; p++) {
+        if (*p == '/') {
+            *p = '_';
+        }
+    }
+    work_dir = xasprintf("%s/%s", root, name);
+    free(name);
+
+    if (mkdir(work_dir, 0755) < 0 && errno != EEXIST) {
+        VLOG_WARN("%s: cannot create (%s)", work_dir, ovs_strerror(errno));
+        goto fail;
+    }
+    desc_clear(work_dir, NULL);
+
+    if (desc_link(dir, work_dir)) {
+        goto fail;
+    }
+    goto out;
+
+fail:
+    powerd_desc_unstage(work_dir);
+    free(work_dir);
+    work_dir = NULL;
+out:
+    free(root);
+    return(work_dir);
+}
+
+/* link the files of "dir" into a staging directory again, so that files
+   added to or removed from "dir" since it was staged are seen; returns 0
+   or an errno value */
+int
+powerd_desc_restage(const char *dir, const char *work_dir)
+{
+    return(desc_link(dir, work_dir));
+}
+
+/* remove the staging directory of a subsystem */
+void
+powerd_desc_unstage(const char *work_dir)
+{
+    if (work_dir != NULL) {
+        desc_clear(work_dir, NULL);
+        rmdir(work_dir);
+    }
+}
@@ -0,0 +1,885 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for the ops-powerd i2c request queues
+ ***************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ovs-atomic.h"
+#include "ovs-thread.h"
+#include "poll-loop.h"
+#include "seq.h"
+#include "shash.h"
+#include "simap.h"
+#include "sset.h"
+#include "timeval.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_i2c.h"
+#include "powerd_metrics.h"
+#include "powerd_probes.h"
+#include "powerd_trace.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_i2c);
+
+/* weight of a new sample in the service time average, as 1/N */
+#define I2C_SERVICE_EWMA_WEIGHT 8
+
+/* most read requests of one class executed as one batch */
+#define I2C_BATCH_MAX  16
+
+/* distinct registers read in one batch */
+#define I2C_BATCH_REGS  (I2C_BATCH_MAX * I2C_REQ_MAX_OPS)
+
+static const char *i2c_prio_name[I2C_PRIO_MAX] = {
+    "status",
+    "led",
+    "telemetry",
+    "fru"
+};
+
+/* per priority class statistics of one bus (main thread only) */
+struct powerd_i2c_stats {
+    unsigned long long int count;     /* requests completed */
+    unsigned long long int failures;  /* requests with a failed op */
+    long long int wait_total;         /* sum of queueing delays (us) */
+    long long int wait_max;           /* longest queueing delay (us) */
+    long long int service_total;      /* sum of execution times (us) */
+    long long int service_max;        /* longest execution time (us) */
+    struct powerd_histogram wait_hist;    /* queueing delays */
+    struct powerd_histogram service_hist; /* execution times */
+};
+
+/* one physical bus, with its queues and worker thread */
+struct powerd_i2c_bus {
+    char *name;                       /* devname of the bus adapter */
+    pthread_t thread;
+
+    struct ovs_mutex mutex;
+    pthread_cond_t cond;              /* signalled when work is queued */
+    struct powerd_i2c_req *head[I2C_PRIO_MAX] OVS_GUARDED;
+    struct powerd_i2c_req *tail[I2C_PRIO_MAX] OVS_GUARDED;
+    unsigned int depth OVS_GUARDED;      /* requests queued, all classes */
+    unsigned int max_depth OVS_GUARDED;  /* high water mark of depth */
+    bool exiting OVS_GUARDED;
+
+    /* worker thread only: devices that have been accessed before, by
+       powerd_i2c_device_key() */
+    struct sset warm_devices;
+
+    /* accesses being recorded, or NULL */
+    struct powerd_trace_ring *trace;
+
+    /* worker thread only: devices whose whole-register reads failed where
+       reads of single bits succeeded, so they are never combined, by
+       powerd_i2c_device_key() */
+    struct sset single_devices;
+
+    /* written by the worker thread, read by ops-powerd/dump */
+    atomic_uint64_t accesses;         /* register accesses made */
+    atomic_uint64_t shared;           /* reads answered by another's access */
+    atomic_uint64_t fallbacks;        /* combined reads redone singly */
+    atomic_uint64_t batches;          /* batches of read requests */
+    atomic_uint64_t batch_time;       /* hardware time of the batches (us) */
+
+    /* main thread only */
+    struct powerd_i2c_stats stats[I2C_PRIO_MAX];
+    long long int service_avg;        /* average status request time (us) */
+    long long int charged;            /* budget charged this wakeup (us) */
+};
+
+static YamlConfigHandle i2c_yaml_handle;
+
+/* combine the reads of a batch per register; cleared with --single-reads */
+static bool i2c_combine = true;
+
+/* buses by name (main thread only) */
+static struct shash i2c_buses = SHASH_INITIALIZER(&i2c_buses);
+
+/* requests submitted and not yet completed, by subsystem (main thread) */
+static struct simap i2c_outstanding = SIMAP_INITIALIZER(&i2c_outstanding);
+
+/* Held for reading around every hardware access and for writing while
+ * hardware descriptions are parsed, so that the config-yaml data is never
+ * modified underneath a worker. */
+static struct ovs_rwlock desc_rwlock;
+
+/* completed requests, waiting for the main thread */
+static struct ovs_mutex done_mutex;
+static struct powerd_i2c_req *done_head OVS_GUARDED_BY(done_mutex);
+static struct powerd_i2c_req *done_tail OVS_GUARDED_BY(done_mutex);
+static struct seq *done_seq;
+static uint64_t done_seqno;
+
+/* create a request; ops are added with powerd_i2c_req_add_*() */
+struct powerd_i2c_req *
+powerd_i2c_req_create(enum powerd_i2c_prio prio, const char *subsystem,
+                      const char *owner, powerd_i2c_cb *cb)
+{
+    struct powerd_i2c_req *req = xzalloc(sizeof *req);
+
+    req->prio = prio;
+    req->subsystem = xstrdup(subsystem);
+    req->owner = xstrdup(owner);
+    req->cb = cb;
+
+    return(req);
+}
+
+void
+powerd_i2c_req_add_read(struct powerd_i2c_req *req, const i2c_bit_op *op)
+{
+    ovs_assert(req->n_ops < I2C_REQ_MAX_OPS);
+    req->write = false;
+    if (powerd_trace_recording()) {
+        req->op_ids[req->n_ops] = powerd_trace_op_id(req->subsystem, op);
+    }
+    req->ops[req->n_ops++] = op;
+}
+
+void
+powerd_i2c_req_add_write(struct powerd_i2c_req *req, const i2c_bit_op *op,
+                         uint32_t value)
+{
+    ovs_assert(req->n_ops < I2C_REQ_MAX_OPS);
+    req->write = true;
+    req->values[req->n_ops] = value;
+    if (powerd_trace_recording()) {
+        req->op_ids[req->n_ops] = powerd_trace_op_id(req->subsystem, op);
+    }
+    req->ops[req->n_ops++] = op;
+}
+
+void
+powerd_i2c_req_destroy(struct powerd_i2c_req *req)
+{
+    if (req != NULL) {
+        free(req->subsystem);
+        free(req->owner);
+        free(req);
+    }
+}
+
+/* take the oldest request of the highest priority class */
+static struct powerd_i2c_req *
+powerd_i2c_bus_pop(struct powerd_i2c_bus *bus)
+    OVS_REQUIRES(bus->mutex)
+{
+    int prio;
+
+    for (prio = 0; prio < I2C_PRIO_MAX; prio++) {
+        struct powerd_i2c_req *req = bus->head[prio];
+
+        if (req != NULL) {
+            bus->head[prio] = req->next;
+            if (bus->head[prio] == NULL) {
+                bus->tail[prio] = NULL;
+            }
+            req->next = NULL;
+            bus->depth--;
+            return(req);
+        }
+    }
+
+    return(NULL);
+}
+
+/* take the oldest request of class "prio" if it is a read */
+static struct powerd_i2c_req *
+powerd_i2c_bus_pop_read(struct powerd_i2c_bus *bus, enum powerd_i2c_prio prio)
+    OVS_REQUIRES(bus->mutex)
+{
+    struct powerd_i2c_req *req = bus->head[prio];
+
+    if (req == NULL || req->write) {
+        return(NULL);
+    }
+    bus->head[prio] = req->next;
+    if (bus->head[prio] == NULL) {
+        bus->tail[prio] = NULL;
+    }
+    req->next = NULL;
+    bus->depth--;
+
+    return(req);
+}
+
+/* a bus may carry the devices of several subsystems, whose device names
+   need not differ, so devices are known to a bus by subsystem and name */
+#define I2C_DEVICE_KEY_LEN  128
+
+static const char *
+powerd_i2c_device_key(char key[I2C_DEVICE_KEY_LEN], const char *subsystem,
+                      const char *device)
+{
+    snprintf(key, I2C_DEVICE_KEY_LEN, "%s/%s", subsystem, device);
+    return(key);
+}
+
+/* lock out descriptor changes for an access to "device". config-yaml sets
+   up device state on first use; do that with every other worker
+   excluded, after that accesses can overlap */
+static void
+powerd_i2c_access_lock(struct powerd_i2c_bus *bus, const char *subsystem,
+                       const char *device)
+{
+    char key[I2C_DEVICE_KEY_LEN];
+
+    powerd_i2c_device_key(key, subsystem, device);
+    if (!sset_contains(&bus->warm_devices, key)) {
+        ovs_rwlock_wrlock(&desc_rwlock);
+        sset_add(&bus->warm_devices, key);
+    } else {
+        ovs_rwlock_rdlock(&desc_rwlock);
+    }
+}
+
+/* the result of a failed register access, I2C_RC_NO_DEVICE if the device
+   did not acknowledge its address */
+static int
+powerd_i2c_failure(int rc)
+{
+    if (rc == -ENXIO || rc == -EREMOTEIO) {
+        return(I2C_RC_NO_DEVICE);
+    }
+    return(rc);
+}
+
+/* execute one op on the hardware, recording it if a trace is open */
+static int
+powerd_i2c_execute_op(struct powerd_i2c_bus *bus, struct powerd_i2c_req *req,
+                      size_t i)
+{
+    const i2c_bit_op *op = req->ops[i];
+    long long int start = 0;
+    uint64_t orig;
+    int rc;
+
+    atomic_add_relaxed(&bus->accesses, 1, &orig);
+    if (bus->trace != NULL) {
+        start = time_usec();
+    }
+    if (req->write) {
+        rc = i2c_reg_write(i2c_yaml_handle, req->subsystem, op,
+                           req->values[i]);
+    } else {
+        rc = i2c_reg_read(i2c_yaml_handle, req->subsystem, op,
+                          &req->values[i]);
+    }
+    if (rc != 0) {
+        rc = powerd_i2c_failure(rc);
+    }
+    if (bus->trace != NULL) {
+        powerd_trace_put(bus->trace, req->op_ids[i], req->write,
+                         req->values[i], rc, start, time_usec() - start);
+    }
+
+    return(rc);
+}
+
+/* execute the ops of a request, in order, on the worker thread. While a
+   trace is replayed the results come from the trace instead. */
+static void
+powerd_i2c_execute(struct powerd_i2c_bus *bus, struct powerd_i2c_req *req)
+{
+    size_t i;
+
+    for (i = 0; i < req->n_ops; i++) {
+        const i2c_bit_op *op = req->ops[i];
+
+        powerd_i2c_access_lock(bus, req->subsystem, op->device);
+        POWERD_PROBE4(i2c_op_start, req->subsystem, op->device,
+                      op->register_address, req->write);
+        if (powerd_trace_replaying()) {
+            req->rcs[i] = powerd_trace_replay_op(req->subsystem, op,
+                                                 req->write, &req->values[i]);
+        } else {
+            req->rcs[i] = powerd_i2c_execute_op(bus, req, i);
+        }
+        POWERD_PROBE6(i2c_op_done, req->subsystem, op->device,
+                      op->register_address, req->write, req->values[i],
+                      req->rcs[i]);
+
+        ovs_rwlock_unlock(&desc_rwlock);
+    }
+}
+
+/* one register read on behalf of every op of a batch that addresses it */
+struct i2c_batch_reg {
+    const i2c_bit_op *op;             /* first op on the register */
+    char key[I2C_DEVICE_KEY_LEN];     /* device, by subsystem and name */
+    uint32_t value;                   /* whole register */
+    int rc;
+};
+
+/* the mask covering a whole register of "size" bytes */
+static uint32_t
+powerd_i2c_full_mask(int size)
+{
+    return(size >= 4 ? UINT32_MAX : (UINT32_C(1) << (8 * size)) - 1);
+}
+
+/* read a whole register once for the batch */
+static void
+powerd_i2c_read_reg(struct powerd_i2c_bus *bus, const char *subsystem,
+                    struct i2c_batch_reg *reg)
+{
+    i2c_bit_op whole = *reg->op;
+    uint64_t orig;
+
+    whole.bit_mask = powerd_i2c_full_mask(whole.register_size);
+
+    powerd_i2c_access_lock(bus, subsystem, whole.device);
+    POWERD_PROBE4(i2c_op_start, subsystem, whole.device,
+                  whole.register_address, false);
+    reg->rc = i2c_reg_read(i2c_yaml_handle, subsystem, &whole, &reg->value);
+    if (reg->rc != 0) {
+        reg->rc = powerd_i2c_failure(reg->rc);
+    }
+    POWERD_PROBE6(i2c_op_done, subsystem, whole.device,
+                  whole.register_address, false, reg->value, reg->rc);
+    ovs_rwlock_unlock(&desc_rwlock);
+
+    atomic_add_relaxed(&bus->accesses, 1, &orig);
+}
+
+/************************************************************************//**
+ * Function that executes a batch of read requests, reading each register
+ * they address once.
+ *
+ * The bits of every op are taken from the single read of its register,
+ * as i2c_reg_read() would have masked them. If a whole-register read
+ * fails, its ops are read singly; a device where that then succeeds is
+ * not combined again, for adapters that reject the wider read. A device
+ * that does not acknowledge its address, such as an absent psu, is not
+ * there for the rest of the batch: its ops fail with I2C_RC_NO_DEVICE
+ * without another access.
+ ***************************************************************************/
+static void
+powerd_i2c_execute_batch(struct powerd_i2c_bus *bus,
+                         struct powerd_i2c_req **batch, size_t n)
+{
+    struct i2c_batch_reg regs[I2C_BATCH_REGS];
+    char key[I2C_DEVICE_KEY_LEN];
+    struct sset absent;
+    size_t n_regs = 0;
+    long long int start = time_usec();
+    uint64_t orig;
+    size_t i, j, k;
+
+    sset_init(&absent);
+    for (i = 0; i < n; i++) {
+        struct powerd_i2c_req *req = batch[i];
+
+        req->started = start;
+        for (j = 0; j < req->n_ops; j++) {
+            const i2c_bit_op *op = req->ops[j];
+            struct i2c_batch_reg *reg = NULL;
+
+            powerd_i2c_device_key(key, req->subsystem, op->device);
+            if (sset_contains(&absent, key)) {
+                req->rcs[j] = I2C_RC_NO_DEVICE;
+                continue;
+            }
+            if (sset_contains(&bus->single_devices, key)) {
+                powerd_i2c_access_lock(bus, req->subsystem, op->device);
+                req->rcs[j] = powerd_i2c_execute_op(bus, req, j);
+                ovs_rwlock_unlock(&desc_rwlock);
+                if (req->rcs[j] == I2C_RC_NO_DEVICE) {
+                    sset_add(&absent, key);
+                }
+                continue;
+            }
+
+            for (k = 0; k < n_regs; k++) {
+                const i2c_bit_op *seen = regs[k].op;
+
+                if (seen->register_address == op->register_address
+                    && seen->register_size == op->register_size
+                    && !strcmp(regs[k].key, key)) {
+                    reg = &regs[k];
+                    atomic_add_relaxed(&bus->shared, 1, &orig);
+                    break;
+                }
+            }
+            if (reg == NULL) {
+                reg = &regs[n_regs++];
+                reg->op = op;
+                ovs_strlcpy(reg->key, key, sizeof reg->key);
+                powerd_i2c_read_reg(bus, req->subsystem, reg);
+            }
+
+            if (reg->rc == 0) {
+                req->values[j] = reg->value & op->bit_mask;
+                req->rcs[j] = 0;
+                continue;
+            }
+            if (reg->rc == I2C_RC_NO_DEVICE) {
+                /* reading the bits alone would not be answered either */
+                req->rcs[j] = I2C_RC_NO_DEVICE;
+                sset_add(&absent, key);
+                continue;
+            }
+
+            /* the adapter may not do the wider read, try the bits alone */
+            powerd_i2c_access_lock(bus, req->subsystem, op->device);
+            req->rcs[j] = powerd_i2c_execute_op(bus, req, j);
+            ovs_rwlock_unlock(&desc_rwlock);
+            atomic_add_relaxed(&bus->fallbacks, 1, &orig);
+            if (req->rcs[j] == 0) {
+                VLOG_INFO("bus %s: device %s rejects whole register reads, "
+                          "reading single bits", bus->name, op->device);
+                sset_add(&bus->single_devices, key);
+            }
+        }
+    }
+
+    sset_destroy(&absent);
+
+    for (i = 0; i < n; i++) {
+        batch[i]->done = time_usec();
+    }
+    atomic_add_relaxed(&bus->batches, 1, &orig);
+    atomic_add_relaxed(&bus->batch_time, batch[n - 1]->done - start, &orig);
+}
+
+/* hand an executed request back to the main thread */
+static void
+powerd_i2c_complete(struct powerd_i2c_req *req)
+{
+    ovs_mutex_lock(&done_mutex);
+    if (done_tail != NULL) {
+        done_tail->next = req;
+    } else {
+        done_head = req;
+    }
+    done_tail = req;
+    ovs_mutex_unlock(&done_mutex);
+}
+
+/************************************************************************//**
+ * Function that is the worker thread of one bus.
+ *
+ * A read request is executed together with the read requests queued
+ * behind it in its class, reading every register they address once,
+ * unless combining is disabled or register accesses are being traced.
+ ***************************************************************************/
+static void *
+powerd_i2c_bus_main(void *bus_)
+{
+    struct powerd_i2c_bus *bus = bus_;
+
+    for (;;) {
+        struct powerd_i2c_req *batch[I2C_BATCH_MAX];
+        struct powerd_i2c_req *req;
+        bool combine;
+        size_t n = 0;
+        size_t i;
+
+        req = NULL;
+        ovs_mutex_lock(&bus->mutex);
+        while (!bus->exiting && (req = powerd_i2c_bus_pop(bus)) == NULL) {
+            ovs_mutex_cond_wait(&bus->cond, &bus->mutex);
+        }
+        combine = req != NULL && !req->write && i2c_combine
+                  && !powerd_trace_recording() && !powerd_trace_replaying();
+        if (req != NULL) {
+            batch[n++] = req;
+        }
+        while (combine && n < I2C_BATCH_MAX
+               && (batch[n] = powerd_i2c_bus_pop_read(bus, req->prio))) {
+            n++;
+        }
+        ovs_mutex_unlock(&bus->mutex);
+
+        if (req == NULL) {
+            break;
+        }
+
+        if (combine) {
+            powerd_i2c_execute_batch(bus, batch, n);
+        } else {
+            req->started = time_usec();
+            powerd_i2c_execute(bus, req);
+            req->done = time_usec();
+        }
+
+        for (i = 0; i < n; i++) {
+            powerd_i2c_complete(batch[i]);
+        }
+        seq_change(done_seq);
+    }
+
+    return(NULL);
+}
+
+/* find the bus that a bit operation is on, creating it if necessary.
+ * A bus is the adapter named by the devname of the device's bus in the
+ * devices description, so subsystems behind the same adapter, or the same
+ * mux, share its worker and never drive it in parallel. An op whose
+ * device or bus is not described gets a queue of its own, named after
+ * the subsystem and the bus or device. */
+static struct powerd_i2c_bus *
+powerd_i2c_find_bus(const char *subsystem, const i2c_bit_op *op)
+{
+    const YamlDevice *device;
+    const YamlBus *yaml_bus = NULL;
+    struct powerd_i2c_bus *bus;
+    char *name;
+
+    device = yaml_find_device(i2c_yaml_handle, subsystem, op->device);
+    if (device != NULL && device->bus != NULL) {
+        yaml_bus = yaml_find_bus(i2c_yaml_handle, subsystem, device->bus);
+    }
+    if (yaml_bus != NULL && yaml_bus->devname != NULL) {
+        name = xstrdup(yaml_bus->devname);
+    } else {
+        name = xasprintf("%s/%s", subsystem,
+                         device != NULL && device->bus != NULL ? device->bus
+                                                               : op->device);
+    }
+
+    bus = shash_find_data(&i2c_buses, name);
+    if (bus == NULL) {
+        bus = xzalloc(sizeof *bus);
+        bus->name = name;
+        ovs_mutex_init(&bus->mutex);
+        xpthread_cond_init(&bus->cond, NULL);
+        sset_init(&bus->warm_devices);
+        sset_init(&bus->single_devices);
+        atomic_init(&bus->accesses, 0);
+        atomic_init(&bus->shared, 0);
+        atomic_init(&bus->fallbacks, 0);
+        atomic_init(&bus->batches, 0);
+        atomic_init(&bus->batch_time, 0);
+        bus->trace = powerd_trace_ring_create();
+        shash_add(&i2c_buses, name, bus);
+        bus->thread = ovs_thread_create("powerd_i2c", powerd_i2c_bus_main,
+                                        bus);
+        VLOG_DBG("created i2c queue for bus %s", name);
+    } else {
+        free(name);
+    }
+
+    return(bus);
+}
+
+/************************************************************************//**
+ * Function that queues a request on the bus of its first operation.
+ *
+ * The request belongs to the i2c queues until its callback has run; the
+ * callback does not own it and must not free it.
+ ***************************************************************************/
+void
+powerd_i2c_submit(struct powerd_i2c_req *req)
+{
+    struct powerd_i2c_bus *bus;
+
+    ovs_assert(req->n_ops > 0);
+    bus = powerd_i2c_find_bus(req->subsystem, req->ops[0]);
+
+    req->bus = bus;
+    req->next = NULL;
+    req->queued = time_usec();
+    simap_increase(&i2c_outstanding, req->subsystem, 1);
+
+    ovs_mutex_lock(&bus->mutex);
+    if (bus->tail[req->prio] != NULL) {
+        bus->tail[req->prio]->next = req;
+    } else {
+        bus->head[req->prio] = req;
+    }
+    bus->tail[req->prio] = req;
+    bus->depth++;
+    if (bus->depth > bus->max_depth) {
+        bus->max_depth = bus->depth;
+    }
+    xpthread_cond_signal(&bus->cond);
+    ovs_mutex_unlock(&bus->mutex);
+}
+
+/* account a completed request in the statistics of its bus */
+static void
+powerd_i2c_account(struct powerd_i2c_req *req)
+{
+    struct powerd_i2c_stats *stats = &req->bus->stats[req->prio];
+    long long int wait = req->started - req->queued;
+    long long int service = req->done - req->started;
+    struct simap_node *node;
+    size_t i;
+
+    node = simap_find(&i2c_outstanding, req->subsystem);
+    if (node != NULL && --node->data == 0) {
+        simap_delete(&i2c_outstanding, node);
+    }
+
+    stats->count++;
+    for (i = 0; i < req->n_ops; i++) {
+        if (req->rcs[i] != 0) {
+            stats->failures++;
+            break;
+        }
+    }
+    stats->wait_total += wait;
+    stats->wait_max = MAX(stats->wait_max, wait);
+    stats->service_total += service;
+    stats->service_max = MAX(stats->service_max, service);
+    powerd_histogram_add(&stats->wait_hist, wait);
+    powerd_histogram_add(&stats->service_hist, service);
+
+    if (req->prio == I2C_PRIO_STATUS) {
+        req->bus->service_avg += (service - req->bus->service_avg)
+                                 / I2C_SERVICE_EWMA_WEIGHT;
+        if (req->bus->service_avg == 0) {
+            req->bus->service_avg = service;
+        }
+    }
+}
+
+/* true if no request of "subsystem" is queued or executing */
+bool
+powerd_i2c_idle(const char *subsystem)
+{
+    return(simap_get(&i2c_outstanding, subsystem) == 0);
+}
+
+/************************************************************************//**
+ * Function that charges the estimated cost of a status read against the
+ * budget of the bus it would be queued on.
+ *
+ * The estimate is the running average execution time of status requests
+ * on that bus. Returns false, and charges nothing, if the bus has already
+ * been given budget_usec of work since the last powerd_i2c_budget_reset();
+ * the first request of a wakeup is always accepted.
+ ***************************************************************************/
+bool
+powerd_i2c_charge(const char *subsystem, const i2c_bit_op *op,
+                  long long int budget_usec)
+{
+    struct powerd_i2c_bus *bus = powerd_i2c_find_bus(subsystem, op);
+
+    if (budget_usec > 0 && bus->charged > 0 && bus->charged >= budget_usec) {
+        return(false);
+    }
+    bus->charged += MAX(bus->service_avg, 1);
+
+    return(true);
+}
+
+/* start a new budget interval on every bus */
+void
+powerd_i2c_budget_reset(void)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &i2c_buses) {
+        struct powerd_i2c_bus *bus = node->data;
+        bus->charged = 0;
+    }
+}
+
+/* exclude all hardware accesses while hw descriptions are being parsed */
+void
+powerd_i2c_desc_lock(void)
+{
+    ovs_rwlock_wrlock(&desc_rwlock);
+}
+
+void
+powerd_i2c_desc_unlock(void)
+{
+    ovs_rwlock_unlock(&desc_rwlock);
+}
+
+/* run the callbacks of all completed requests, then free them */
+void
+powerd_i2c_run(void)
+{
+    struct powerd_i2c_req *req;
+
+    done_seqno = seq_read(done_seq);
+
+    ovs_mutex_lock(&done_mutex);
+    req = done_head;
+    done_head = done_tail = NULL;
+    ovs_mutex_unlock(&done_mutex);
+
+    while (req != NULL) {
+        struct powerd_i2c_req *next = req->next;
+
+        powerd_i2c_account(req);
+        POWERD_PROBE4(i2c_req_done, req->owner, req->prio,
+                      req->started - req->queued, req->done - req->started);
+        if (req->cb != NULL) {
+            req->cb(req);
+        }
+        powerd_i2c_req_destroy(req);
+        req = next;
+    }
+}
+
+/* wake up the main loop when a request completes */
+void
+powerd_i2c_wait(void)
+{
+    seq_wait(done_seq, done_seqno);
+}
+
+/* report queue depths and wait times for ops-powerd/dump */
+void
+powerd_i2c_dump(struct ds *ds)
+{
+    const struct shash_node **nodes;
+    size_t i;
+    int prio;
+
+    ds_put_cstr(ds, "I2C queues:\n");
+    nodes = shash_sort(&i2c_buses);
+    for (i = 0; i < shash_count(&i2c_buses); i++) {
+        struct powerd_i2c_bus *bus = nodes[i]->data;
+        uint64_t accesses, shared, fallbacks, batches, batch_time;
+        unsigned int depth, max_depth;
+
+        ovs_mutex_lock(&bus->mutex);
+        depth = bus->depth;
+        max_depth = bus->max_depth;
+        ovs_mutex_unlock(&bus->mutex);
+
+        ds_put_format(ds, "    bus %s: depth %u, max depth %u\n",
+                      bus->name, depth, max_depth);
+        atomic_read_relaxed(&bus->accesses, &accesses);
+        atomic_read_relaxed(&bus->shared, &shared);
+        atomic_read_relaxed(&bus->fallbacks, &fallbacks);
+        atomic_read_relaxed(&bus->batches, &batches);
+        atomic_read_relaxed(&bus->batch_time, &batch_time);
+        ds_put_format(ds, "        accesses %"PRIu64", reads shared "
+                      "%"PRIu64", fallbacks %"PRIu64", batches %"PRIu64
+                      ", bus time per batch %"PRIu64" us\n",
+                      accesses, shared, fallbacks, batches,
+                      batches != 0 ? batch_time / batches : 0);
+        for (prio = 0; prio < I2C_PRIO_MAX; prio++) {
+            const struct powerd_i2c_stats *stats = &bus->stats[prio];
+
+            if (stats->count == 0) {
+                continue;
+            }
+            ds_put_format(ds, "        %-9s requests %llu, failed %llu, "
+                          "wait avg/max %lld/%lld us, "
+                          "service avg/max %lld/%lld us\n",
+                          i2c_prio_name[prio], stats->count, stats->failures,
+                          stats->wait_total / (long long int) stats->count,
+                          stats->wait_max,
+                          stats->service_total / (long long int) stats->count,
+                          stats->service_max);
+        }
+    }
+    free(nodes);
+}
+
+/* read every bit op on its own, as the hardware was accessed before
+   reads were combined */
+void
+powerd_i2c_set_combine(bool combine)
+{
+    i2c_combine = combine;
+}
+
+void
+powerd_i2c_init(YamlConfigHandle handle)
+{
+    i2c_yaml_handle = handle;
+    ovs_rwlock_init(&desc_rwlock);
+    ovs_mutex_init(&done_mutex);
+    done_seq = seq_create();
+    done_seqno = seq_read(done_seq);
+}
+
+/* stop the worker threads; requests still queued are dropped */
+void
+powerd_i2c_exit(void)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &i2c_buses) {
+        struct powerd_i2c_bus *bus = node->data;
+
+        ovs_mutex_lock(&bus->mutex);
+        bus->exiting = true;
+        xpthread_cond_signal(&bus->cond);
+        ovs_mutex_unlock(&bus->mutex);
+    }
+
+    SHASH_FOR_EACH(node, &i2c_buses) {
+        struct powerd_i2c_bus *bus = node->data;
+        struct powerd_i2c_req *req;
+
+        xpthread_join(bus->thread, NULL);
+
+        ovs_mutex_lock(&bus->mutex);
+        while ((req = powerd_i2c_bus_pop(bus)) != NULL) {
+            powerd_i2c_req_destroy(req);
+        }
+        ovs_mutex_unlock(&bus->mutex);
+    }
+    simap_clear(&i2c_outstanding);
+}
+
+/* append the i2c request histograms, per bus and priority, to a metrics
+   page. "labels" is scratch space for the labels of each series. */
+void
+powerd_i2c_metrics(struct ds *ds, struct ds *labels)
+{
+    static const char *names[] = {
+        "powerd_i2c_queue_seconds", "powerd_i2c_service_seconds"
+    };
+    struct shash_node *node;
+    size_t i;
+    int prio;
+
+    for (i = 0; i < ARRAY_SIZE(names); i++) {
+        ds_put_format(ds, "# HELP %s Hardware request %s time.\n", names[i],
+                      i == 0 ? "queueing" : "execution");
+        ds_put_format(ds, "# TYPE %s histogram\n", names[i]);
+        SHASH_FOR_EACH(node, &i2c_buses) {
+            struct powerd_i2c_bus *bus = node->data;
+
+            for (prio = 0; prio < I2C_PRIO_MAX; prio++) {
+                const struct powerd_i2c_stats *stats = &bus->stats[prio];
+
+                if (stats->count == 0) {
+                    continue;
+                }
+                ds_clear(labels);
+                powerd_metrics_put_label(labels, "bus", bus->name);
+                ds_put_char(labels, ',');
+                powerd_metrics_put_label(labels, "priority",
+                                         i2c_prio_name[prio]);
+                powerd_metrics_put_histogram(ds, names[i], ds_cstr(labels),
+                                             i == 0 ? &stats->wait_hist
+                                                    : &stats->service_hist);
+            }
+        }
+    }
+}
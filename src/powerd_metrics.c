@@ -0,0 +1,350 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source for the ops-powerd OpenMetrics endpoint
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "poll-loop.h"
+#include "stream.h"
+#include "timeval.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_metrics.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_metrics);
+
+/* most connections accepted per main loop iteration */
+#define METRICS_MAX_ACCEPT  8
+
+/* time (ms) a scrape has to take its page before it is dropped */
+#define METRICS_CONN_TIMEOUT  5000
+
+#define METRICS_HEADER "HTTP/1.0 200 OK\r\n" \
+    "Content-Type: application/openmetrics-text; version=1.0.0; " \
+    "charset=utf-8\r\n" \
+    "Connection: close\r\n" \
+    "\r\n"
+
+/* upper bounds (us) of the histogram buckets, but the last */
+static const long long int bucket_bounds[METRICS_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+/* a rendered page with its header, shared by the scrapes sending it */
+struct metrics_page {
+    struct ds ds;
+    int refs;
+};
+
+/* one scrape being answered */
+struct metrics_conn {
+    struct metrics_conn *next;
+    struct stream *stream;
+    struct metrics_page *page;        /* page being sent */
+    size_t sent;                      /* bytes of the page sent so far */
+    long long int deadline;           /* time (ms) the scrape is dropped */
+};
+
+static char *metrics_path;
+static struct pstream *metrics_pstream;
+static struct metrics_conn *metrics_conns;
+static powerd_metrics_render_cb *metrics_render_cb;
+
+/* set once opening the socket failed, until it is closed again */
+static bool metrics_open_failed;
+
+/* latest page; its allocation is kept from one scrape to the next unless
+   a scrape is still sending it */
+static struct metrics_page *metrics_page;
+
+void
+powerd_histogram_add(struct powerd_histogram *hist, long long int usec)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(bucket_bounds); i++) {
+        if (usec <= bucket_bounds[i]) {
+            break;
+        }
+    }
+    hist->buckets[i]++;
+    hist->count++;
+    hist->sum += usec;
+}
+
+/* append name="value" with the value escaped as OpenMetrics requires */
+void
+powerd_metrics_put_label(struct ds *ds, const char *name, const char *value)
+{
+    const char *p;
+
+    ds_put_format(ds, "%s=\"", name);
+    for (p = value; *p != '\0'; p++) {
+        switch (*p) {
+        case '\\':
+            ds_put_cstr(ds, "\\\\");
+            break;
+        case '"':
+            ds_put_cstr(ds, "\\\"");
+            break;
+        case '\n':
+            ds_put_cstr(ds, "\\n");
+            break;
+        default:
+            ds_put_char(ds, *p);
+            break;
+        }
+    }
+    ds_put_char(ds, '"');
+}
+
+/* append the samples of a histogram, in seconds. "labels" is a list of
+   already escaped labels, possibly empty. */
+void
+powerd_metrics_put_histogram(struct ds *ds, const char *name,
+                             const char *labels,
+                             const struct powerd_histogram *hist)
+{
+    const char *sep = labels[0] != '\0' ? "," : "";
+    unsigned long long int cumulative = 0;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(bucket_bounds); i++) {
+        cumulative += hist->buckets[i];
+        ds_put_format(ds, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep,
+                      bucket_bounds[i] / 1e6, cumulative);
+    }
+    ds_put_format(ds, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep,
+                  hist->count);
+    ds_put_format(ds, "%s_count{%s} %llu\n", name, labels, hist->count);
+    ds_put_format(ds, "%s_sum{%s} %g\n", name, labels, hist->sum / 1e6);
+}
+
+static void
+metrics_page_unref(struct metrics_page *page)
+{
+    if (page != NULL && --page->refs == 0) {
+        ds_destroy(&page->ds);
+        free(page);
+    }
+}
+
+/* render the page and return it, without the HTTP header. Scrapes still
+   sending an older page keep it. */
+const char *
+powerd_metrics_render(void)
+{
+    if (metrics_page == NULL || metrics_page->refs > 1) {
+        metrics_page_unref(metrics_page);
+        metrics_page = xmalloc(sizeof *metrics_page);
+        ds_init(&metrics_page->ds);
+        metrics_page->refs = 1;
+    }
+
+    ds_clear(&metrics_page->ds);
+    ds_put_cstr(&metrics_page->ds, METRICS_HEADER);
+    metrics_render_cb(&metrics_page->ds);
+    ds_put_cstr(&metrics_page->ds, "# EOF\n");
+
+    return(ds_cstr(&metrics_page->ds) + strlen(METRICS_HEADER));
+}
+
+void
+powerd_metrics_init(const char *path, powerd_metrics_render_cb *cb)
+{
+    metrics_path = xstrdup(path);
+    metrics_render_cb = cb;
+}
+
+/************************************************************************//**
+ * Function that starts listening for scrapes on the unix socket given to
+ * powerd_metrics_init(), if it is not listening yet.
+ *
+ * Creating the socket replaces one left at the same path, so the daemon
+ * only listens while it holds its lock. The endpoint is optional: if the
+ * socket cannot be created, an error is logged and the daemon runs
+ * without it until the next powerd_metrics_close().
+ ***************************************************************************/
+void
+powerd_metrics_open(void)
+{
+    char *name;
+    int error;
+
+    if (metrics_pstream != NULL || metrics_open_failed) {
+        return;
+    }
+
+    name = xasprintf("punix:%s", metrics_path);
+    error = pstream_open(name, &metrics_pstream, 0);
+    if (error) {
+        VLOG_ERR("%s: could not listen for metrics scrapes (%s)",
+                 metrics_path, ovs_strerror(error));
+        metrics_pstream = NULL;
+        metrics_open_failed = true;
+    }
+    free(name);
+}
+
+static void
+metrics_conn_close(struct metrics_conn *conn)
+{
+    stream_close(conn->stream);
+    metrics_page_unref(conn->page);
+    free(conn);
+}
+
+/* stop listening, dropping the scrapes in flight */
+void
+powerd_metrics_close(void)
+{
+    while (metrics_conns != NULL) {
+        struct metrics_conn *next = metrics_conns->next;
+
+        metrics_conn_close(metrics_conns);
+        metrics_conns = next;
+    }
+    pstream_close(metrics_pstream);
+    metrics_pstream = NULL;
+    metrics_open_failed = false;
+}
+
+void
+powerd_metrics_exit(void)
+{
+    powerd_metrics_close();
+    metrics_page_unref(metrics_page);
+    metrics_page = NULL;
+    free(metrics_path);
+    metrics_path = NULL;
+}
+
+/* send what the socket takes of the page; true when the conn is done */
+static bool
+metrics_conn_run(struct metrics_conn *conn)
+{
+    const struct ds *page = &conn->page->ds;
+    char discard[256];
+    int retval;
+
+    if (time_msec() >= conn->deadline) {
+        VLOG_DBG("metrics scrape timed out after %zu of %zu bytes",
+                 conn->sent, page->length);
+        return(true);
+    }
+
+    /* the request itself does not matter, drain it */
+    while (stream_recv(conn->stream, discard, sizeof discard) > 0) {
+        continue;
+    }
+
+    stream_run(conn->stream);
+    while (conn->sent < page->length) {
+        retval = stream_send(conn->stream, page->string + conn->sent,
+                             page->length - conn->sent);
+        if (retval == -EAGAIN) {
+            return(false);
+        } else if (retval < 0) {
+            VLOG_DBG("metrics scrape failed (%s)", ovs_strerror(-retval));
+            return(true);
+        }
+        conn->sent += retval;
+    }
+
+    return(true);
+}
+
+/************************************************************************//**
+ * Function that accepts new scrapes and sends pending pages.
+ *
+ * The page is rendered once for the scrapes accepted in one call, which
+ * share it. A scrape that has not taken its whole page within
+ * METRICS_CONN_TIMEOUT of being accepted is dropped.
+ ***************************************************************************/
+void
+powerd_metrics_run(void)
+{
+    struct metrics_conn **connp;
+    bool rendered = false;
+    int i;
+
+    if (metrics_pstream == NULL) {
+        return;
+    }
+
+    for (i = 0; i < METRICS_MAX_ACCEPT; i++) {
+        struct metrics_conn *conn;
+        struct stream *stream;
+        int error;
+
+        error = pstream_accept(metrics_pstream, &stream);
+        if (error) {
+            if (error != EAGAIN) {
+                VLOG_WARN("metrics accept failed (%s)", ovs_strerror(error));
+            }
+            break;
+        }
+
+        if (!rendered) {
+            powerd_metrics_render();
+            rendered = true;
+        }
+        conn = xzalloc(sizeof *conn);
+        conn->stream = stream;
+        conn->page = metrics_page;
+        conn->page->refs++;
+        conn->deadline = time_msec() + METRICS_CONN_TIMEOUT;
+        conn->next = metrics_conns;
+        metrics_conns = conn;
+    }
+
+    connp = &metrics_conns;
+    while (*connp != NULL) {
+        struct metrics_conn *conn = *connp;
+
+        if (metrics_conn_run(conn)) {
+            *connp = conn->next;
+            metrics_conn_close(conn);
+        } else {
+            connp = &conn->next;
+        }
+    }
+}
+
+void
+powerd_metrics_wait(void)
+{
+    struct metrics_conn *conn;
+
+    if (metrics_pstream == NULL) {
+        return;
+    }
+
+    pstream_wait(metrics_pstream);
+    for (conn = metrics_conns; conn != NULL; conn = conn->next) {
+        stream_run_wait(conn->stream);
+        stream_send_wait(conn->stream);
+        poll_timer_wait_until(conn->deadline);
+    }
+}
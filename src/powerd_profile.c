@@ -0,0 +1,311 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for the ops-powerd main loop profiler and stall watchdog
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ovs-atomic.h"
+#include "ovs-thread.h"
+#include "timeval.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_profile.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_profile);
+
+/* iterations kept for the percentiles */
+#define PROFILE_SAMPLES  1024
+
+/* bounds (ms) of the watchdog check interval */
+#define WATCHDOG_CHECK_MIN  10
+#define WATCHDOG_CHECK_MAX  1000
+
+static const char *phase_name[PHASE_MAX] = {
+    "idl_run",
+    "i2c",
+    "metrics",
+    "reconfigure",
+    "run",
+    "unixctl",
+    "wait"
+};
+
+/* durations (us) of the last PROFILE_SAMPLES runs of one phase, or of
+   whole iterations (main thread only) */
+struct profile_samples {
+    long long int samples[PROFILE_SAMPLES];
+    unsigned long long int count;     /* runs recorded so far */
+    long long int max;                /* longest run ever (us) */
+};
+
+static struct profile_samples phase_samples[PHASE_MAX];
+static struct profile_samples iter_samples;
+
+/* The iteration in progress. Written by the main thread, read by the
+ * watchdog; the watchdog may see a report that is a few microseconds
+ * inconsistent, which does not matter for a stall of milliseconds. */
+static atomic_llong iter_start;              /* time (us), 0 when idle */
+static atomic_llong phase_start;             /* time (us) */
+static atomic_uint32_t cur_phase;
+static atomic_llong phase_time[PHASE_MAX];   /* us spent this iteration */
+static atomic_uint64_t iter_seqno;
+static bool in_iteration;                    /* main thread only */
+
+/* watchdog */
+static long long int watchdog_deadline;      /* ms, 0 if disabled */
+static bool watchdog_abort;
+static pthread_t watchdog_thread;
+static atomic_bool watchdog_exiting;
+static atomic_uint64_t stalls;
+
+static void
+profile_add(struct profile_samples *ps, long long int usec)
+{
+    ps->samples[ps->count % PROFILE_SAMPLES] = usec;
+    ps->count++;
+    ps->max = MAX(ps->max, usec);
+}
+
+/* charge the time since the current phase started to it */
+static void
+profile_phase_end(long long int now)
+{
+    long long int start, spent;
+    uint32_t phase;
+
+    atomic_read_relaxed(&cur_phase, &phase);
+    atomic_read_relaxed(&phase_start, &start);
+    atomic_read_relaxed(&phase_time[phase], &spent);
+    atomic_store_relaxed(&phase_time[phase], MAX(spent, 0) + (now - start));
+}
+
+/* mark the start of "phase"; the first phase starts an iteration. A
+   phase may run more than once in an iteration. */
+void
+powerd_profile_phase(enum powerd_phase phase)
+{
+    long long int now = time_usec();
+
+    if (!in_iteration) {
+        int i;
+
+        /* -1: the phase has not run in this iteration */
+        for (i = 0; i < PHASE_MAX; i++) {
+            atomic_store_relaxed(&phase_time[i], -1);
+        }
+        in_iteration = true;
+        atomic_store_relaxed(&iter_start, now);
+    } else {
+        profile_phase_end(now);
+    }
+
+    atomic_store_relaxed(&cur_phase, phase);
+    atomic_store_relaxed(&phase_start, now);
+}
+
+/* end the iteration, just before poll_block() */
+void
+powerd_profile_idle(void)
+{
+    long long int now = time_usec();
+    long long int start;
+    uint64_t seqno;
+    int i;
+
+    if (!in_iteration) {
+        return;
+    }
+    profile_phase_end(now);
+
+    for (i = 0; i < PHASE_MAX; i++) {
+        long long int spent;
+
+        atomic_read_relaxed(&phase_time[i], &spent);
+        if (spent >= 0) {
+            profile_add(&phase_samples[i], spent);
+        }
+    }
+    atomic_read_relaxed(&iter_start, &start);
+    profile_add(&iter_samples, now - start);
+
+    in_iteration = false;
+    atomic_store_relaxed(&iter_start, 0);
+    atomic_add_relaxed(&iter_seqno, 1, &seqno);
+}
+
+/* log where the stalled iteration has spent its time so far */
+static void
+watchdog_report(long long int now, long long int start)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    long long int pstart;
+    uint32_t phase;
+    int i;
+
+    atomic_read_relaxed(&cur_phase, &phase);
+    atomic_read_relaxed(&phase_start, &pstart);
+
+    for (i = 0; i < PHASE_MAX; i++) {
+        long long int spent;
+
+        atomic_read_relaxed(&phase_time[i], &spent);
+        if (i == phase) {
+            ds_put_format(&ds, "\n    %-11s %lld us (running)", phase_name[i],
+                          MAX(spent, 0) + (now - pstart));
+        } else if (spent >= 0) {
+            ds_put_format(&ds, "\n    %-11s %lld us", phase_name[i], spent);
+        }
+    }
+    VLOG_ERR("main loop stalled for %lld ms in %s, phases so far:%s",
+             (now - start) / 1000, phase_name[phase], ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static void *
+watchdog_main(void *arg OVS_UNUSED)
+{
+    long long int interval = MIN(MAX(watchdog_deadline / 4,
+                                     WATCHDOG_CHECK_MIN),
+                                 WATCHDOG_CHECK_MAX);
+    uint64_t reported = UINT64_MAX;
+
+    for (;;) {
+        long long int start, now;
+        uint64_t seqno, orig;
+        bool exiting;
+
+        xnanosleep(interval * 1000000LL);
+
+        atomic_read_relaxed(&watchdog_exiting, &exiting);
+        if (exiting) {
+            break;
+        }
+
+        atomic_read_relaxed(&iter_seqno, &seqno);
+        atomic_read_relaxed(&iter_start, &start);
+        now = time_usec();
+        if (start == 0 || seqno == reported
+            || now - start < watchdog_deadline * 1000) {
+            continue;
+        }
+
+        /* once per stalled iteration */
+        reported = seqno;
+        atomic_add_relaxed(&stalls, 1, &orig);
+        watchdog_report(now, start);
+        if (watchdog_abort) {
+            /* a core of the stuck main thread is worth more than a clean
+               exit, and the supervisor restarts the daemon either way */
+            VLOG_ERR("aborting on main loop stall");
+            abort();
+        }
+    }
+
+    return(NULL);
+}
+
+/************************************************************************//**
+ * Function that starts the stall watchdog, if "deadline" (ms) is not 0.
+ *
+ * An iteration of the main loop that runs for longer than "deadline"
+ * without reaching poll_block() is reported once, with the time spent in
+ * each phase so far. With "abort_on_stall" the daemon then exits, so that
+ * its supervisor restarts it.
+ ***************************************************************************/
+void
+powerd_profile_init(long long int deadline, bool abort_on_stall)
+{
+    atomic_init(&iter_start, 0);
+    atomic_init(&iter_seqno, 0);
+    atomic_init(&stalls, 0);
+    atomic_init(&watchdog_exiting, false);
+
+    watchdog_deadline = deadline;
+    watchdog_abort = abort_on_stall;
+    if (deadline > 0) {
+        watchdog_thread = ovs_thread_create("powerd_watchdog", watchdog_main,
+                                            NULL);
+    }
+}
+
+void
+powerd_profile_exit(void)
+{
+    if (watchdog_deadline > 0) {
+        atomic_store_relaxed(&watchdog_exiting, true);
+        xpthread_join(watchdog_thread, NULL);
+    }
+}
+
+static int
+compare_llong(const void *a_, const void *b_)
+{
+    const long long int *a = a_;
+    const long long int *b = b_;
+
+    return(*a < *b ? -1 : *a > *b);
+}
+
+/* append percentiles of the recorded runs of one phase */
+static void
+profile_put(struct ds *ds, const char *name, const struct profile_samples *ps)
+{
+    long long int sorted[PROFILE_SAMPLES];
+    size_t n = MIN(ps->count, PROFILE_SAMPLES);
+
+    if (n == 0) {
+        return;
+    }
+    memcpy(sorted, ps->samples, n * sizeof sorted[0]);
+    qsort(sorted, n, sizeof sorted[0], compare_llong);
+
+    ds_put_format(ds, "  %-11s %10llu %8lld %8lld %8lld %8lld %8lld\n",
+                  name, ps->count, sorted[n / 2], sorted[n * 9 / 10],
+                  sorted[n * 99 / 100], sorted[n - 1], ps->max);
+}
+
+/* report phase percentiles for ops-powerd/profile */
+void
+powerd_profile_dump(struct ds *ds)
+{
+    uint64_t n_stalls;
+    int i;
+
+    ds_put_format(ds, "Main loop phases (us), last %d iterations:\n",
+                  PROFILE_SAMPLES);
+    ds_put_format(ds, "  %-11s %10s %8s %8s %8s %8s %8s\n", "phase", "runs",
+                  "p50", "p90", "p99", "max", "max ever");
+    for (i = 0; i < PHASE_MAX; i++) {
+        profile_put(ds, phase_name[i], &phase_samples[i]);
+    }
+    profile_put(ds, "iteration", &iter_samples);
+
+    atomic_read_relaxed(&stalls, &n_stalls);
+    if (watchdog_deadline > 0) {
+        ds_put_format(ds, "Watchdog: deadline %lld ms%s, %llu stalls\n",
+                      watchdog_deadline, watchdog_abort ? ", abort" : "",
+                      (unsigned long long int) n_stalls);
+    } else {
+        ds_put_cstr(ds, "Watchdog: disabled\n");
+    }
+}
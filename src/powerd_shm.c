@@ -0,0 +1,233 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for writing the shared memory psu snapshot
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "timeval.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_shm_writer.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_shm);
+
+/* the segment being written: the shared mapping once it is open, and a
+   private copy before that */
+static struct powerd_shm_segment *seg;
+static struct powerd_shm_segment *private_seg;
+static char *seg_name;
+
+void
+powerd_shm_writer_init(void)
+{
+    private_seg = xzalloc(sizeof *private_seg);
+    private_seg->magic = POWERD_SHM_MAGIC;
+    private_seg->version = POWERD_SHM_VERSION;
+    private_seg->size = sizeof *private_seg;
+    private_seg->psu_size = sizeof private_seg->psus[0];
+    seg = private_seg;
+}
+
+/* detach from the segment, leaving it to a new writer if there is one */
+void
+powerd_shm_writer_close(void)
+{
+    if (seg == private_seg) {
+        return;
+    }
+
+    memcpy(private_seg, seg, sizeof *seg);
+    private_seg->seq &= ~1ULL;
+    munmap(seg, sizeof *seg);
+    seg = private_seg;
+    VLOG_INFO("stopped writing %s", seg_name);
+    free(seg_name);
+    seg_name = NULL;
+}
+
+/* the segment stays behind, so that readers see the last state and that
+   no writer is left */
+void
+powerd_shm_writer_exit(void)
+{
+    if (seg != private_seg && seg->writer_pid == getpid()) {
+        powerd_shm_write_begin();
+        seg->writer_pid = 0;
+        powerd_shm_write_end();
+    }
+    powerd_shm_writer_close();
+    free(private_seg);
+    private_seg = seg = NULL;
+}
+
+/************************************************************************//**
+ * Function that creates or takes over the shared memory segment NAME and
+ * copies the private slots into it.
+ *
+ * The sequence number and the generation continue from those left in the
+ * segment by a previous writer, so that readers holding an old sequence
+ * number or generation retry or look their ids up again.
+ *
+ * @param[in] name  - name of the segment, as for shm_open()
+ *
+ * @return 0 on success, errno value otherwise
+ ***************************************************************************/
+int
+powerd_shm_writer_open(const char *name)
+{
+    struct powerd_shm_segment *shared;
+    uint64_t seq = 0, generation = 0;
+    struct stat st;
+    int fd, error;
+
+    if (seg != private_seg) {
+        return(0);
+    }
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return(errno);
+    }
+    if (fstat(fd, &st) < 0 ||
+        (st.st_size != sizeof *shared && ftruncate(fd, sizeof *shared) < 0)) {
+        error = errno;
+        close(fd);
+        return(error);
+    }
+    shared = mmap(NULL, sizeof *shared, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    error = shared == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (error) {
+        return(error);
+    }
+
+    /* a segment with another layout was sized for it above, and its
+       readers find the magic or the version changed */
+    if (shared->magic == POWERD_SHM_MAGIC &&
+        shared->version == POWERD_SHM_VERSION &&
+        st.st_size == sizeof *shared) {
+        seq = (shared->seq + 1) & ~1ULL;
+        generation = shared->generation;
+    }
+
+    __atomic_store_n(&shared->seq, seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shared->magic, &private_seg->magic,
+           offsetof(struct powerd_shm_segment, seq));
+    memcpy(shared->psus, private_seg->psus, sizeof shared->psus);
+    shared->generation = generation + private_seg->generation + 1;
+    shared->writer_pid = getpid();
+    shared->n_psus = private_seg->n_psus;
+    shared->updated = time_wall_msec();
+    __atomic_store_n(&shared->seq, seq + 2, __ATOMIC_RELEASE);
+
+    seg = shared;
+    seg_name = xstrdup(name);
+    VLOG_INFO("writing psu state to %s", name);
+    return(0);
+}
+
+bool
+powerd_shm_writer_is_open(void)
+{
+    return(seg != private_seg);
+}
+
+/************************************************************************//**
+ * Function that starts a write to the segment. Readers retry until the
+ * matching powerd_shm_write_end(); the writer is the main thread only, so
+ * writes do not nest.
+ *
+ * @return the psu slots, indexed by id
+ ***************************************************************************/
+struct powerd_shm_psu *
+powerd_shm_write_begin(void)
+{
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return(seg->psus);
+}
+
+void
+powerd_shm_write_end(void)
+{
+    seg->updated = time_wall_msec();
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* take a slot for a psu; returns its id, or -1 if every slot is taken */
+int
+powerd_shm_alloc(const char *name)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 60);
+    struct powerd_shm_psu *psus;
+    int id;
+
+    for (id = 0; id < POWERD_SHM_MAX_PSUS; id++) {
+        if (!(seg->psus[id].flags & POWERD_SHM_PSU_USED)) {
+            break;
+        }
+    }
+    if (id == POWERD_SHM_MAX_PSUS) {
+        VLOG_WARN_RL(&rl, "psu %s is not in the shared memory snapshot, "
+                     "all %d slots are taken", name, POWERD_SHM_MAX_PSUS);
+        return(-1);
+    }
+
+    psus = powerd_shm_write_begin();
+    memset(&psus[id], 0, sizeof psus[id]);
+    ovs_strlcpy(psus[id].name, name, sizeof psus[id].name);
+    psus[id].status = POWERD_SHM_UNKNOWN;
+    psus[id].flags = POWERD_SHM_PSU_USED;
+    if (id >= seg->n_psus) {
+        seg->n_psus = id + 1;
+    }
+    seg->generation++;
+    powerd_shm_write_end();
+
+    return(id);
+}
+
+void
+powerd_shm_free(int id)
+{
+    struct powerd_shm_psu *psus;
+
+    if (id < 0 || id >= POWERD_SHM_MAX_PSUS) {
+        return;
+    }
+
+    psus = powerd_shm_write_begin();
+    memset(&psus[id], 0, sizeof psus[id]);
+    while (seg->n_psus > 0 &&
+           !(psus[seg->n_psus - 1].flags & POWERD_SHM_PSU_USED)) {
+        seg->n_psus--;
+    }
+    seg->generation++;
+    powerd_shm_write_end();
+}
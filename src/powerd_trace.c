@@ -0,0 +1,524 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for recording and replaying ops-powerd register traces
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ovs-atomic.h"
+#include "shash.h"
+#include "timeval.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_trace.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_trace);
+
+/* records buffered per bus between two main loop iterations */
+#define TRACE_RING_SIZE  4096
+#define TRACE_RING_MASK  (TRACE_RING_SIZE - 1)
+
+/* most op ids in one trace */
+#define TRACE_MAX_OPS    UINT16_MAX
+
+/* Single producer, single consumer ring: the worker thread of one bus
+ * advances head, the main thread advances tail. */
+struct powerd_trace_ring {
+    struct powerd_trace_ring *next;   /* all rings (main thread only) */
+    atomic_uint64_t head;             /* next slot to fill */
+    atomic_uint64_t tail;             /* next slot to drain */
+    atomic_uint64_t drops;            /* records lost to a full ring */
+    struct powerd_trace_rec recs[TRACE_RING_SIZE];
+};
+
+/* recorded accesses to one register, in the order they were made */
+struct trace_key {
+    struct powerd_trace_rec *recs;
+    size_t n_recs;
+    size_t allocated;
+    size_t cursor;      /* next record to replay (owning worker only) */
+    bool exhausted;     /* end of the records has been reported */
+};
+
+/* recording */
+static FILE *record_file;
+static char *record_name;
+static struct powerd_trace_ring *rings;
+static struct shash record_ops = SHASH_INITIALIZER(&record_ops);
+static unsigned long long int recorded;
+static bool recording;
+
+/* replaying; the keys are not modified once the trace is loaded */
+static struct shash replay_keys = SHASH_INITIALIZER(&replay_keys);
+static char *replay_name;
+static bool replaying;
+static bool replay_realtime;
+static long long int replay_start;   /* time (us) replay started */
+static long long int trace_start;    /* time (us) recording started */
+
+/* key of a register access, "subsystem/device/register/mask" */
+static void
+trace_key_format(char *buf, size_t size, const char *subsystem,
+                 const i2c_bit_op *op)
+{
+    snprintf(buf, size, "%s/%s/%x/%x", subsystem, op->device,
+             (unsigned int) op->register_address,
+             (unsigned int) op->bit_mask);
+}
+
+bool
+powerd_trace_recording(void)
+{
+    return(recording);
+}
+
+bool
+powerd_trace_replaying(void)
+{
+    return(replaying);
+}
+
+/* stop recording after a write error; records are drained and dropped */
+static void
+trace_record_error(int error)
+{
+    VLOG_ERR("%s: recording stopped (%s)", record_name, ovs_strerror(error));
+    fclose(record_file);
+    record_file = NULL;
+}
+
+/************************************************************************//**
+ * Function that starts recording register accesses to "file".
+ *
+ * Returns 0 on success, otherwise an errno value.
+ ***************************************************************************/
+int
+powerd_trace_record_open(const char *file)
+{
+    struct powerd_trace_header header;
+
+    record_file = fopen(file, "wb");
+    if (record_file == NULL) {
+        return(errno);
+    }
+
+    memset(&header, 0, sizeof header);
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.start = time_usec();
+    if (fwrite(&header, sizeof header, 1, record_file) != 1) {
+        int error = errno;
+
+        fclose(record_file);
+        record_file = NULL;
+        return(error);
+    }
+
+    record_name = xstrdup(file);
+    recording = true;
+    VLOG_INFO("%s: recording register accesses", file);
+
+    return(0);
+}
+
+/* create the ring of a new bus, or NULL when not recording */
+struct powerd_trace_ring *
+powerd_trace_ring_create(void)
+{
+    struct powerd_trace_ring *ring;
+
+    if (!recording) {
+        return(NULL);
+    }
+
+    ring = xzalloc(sizeof *ring);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->drops, 0);
+    ring->next = rings;
+    rings = ring;
+
+    return(ring);
+}
+
+/************************************************************************//**
+ * Function that returns the op id of a bit operation, assigning one and
+ * writing its definition to the trace the first time it is seen.
+ *
+ * Ids are assigned by the main thread as requests are built, so the
+ * definition of an op is always in the trace before its first access.
+ ***************************************************************************/
+uint16_t
+powerd_trace_op_id(const char *subsystem, const i2c_bit_op *op)
+{
+    struct powerd_trace_rec rec;
+    char key[256];
+    size_t id;
+    size_t len;
+
+    trace_key_format(key, sizeof key, subsystem, op);
+    id = (uintptr_t) shash_find_data(&record_ops, key);
+    if (id != 0) {
+        return(id - 1);
+    }
+
+    id = shash_count(&record_ops);
+    if (id >= TRACE_MAX_OPS) {
+        VLOG_WARN_ONCE("%s: too many registers, not all are recorded",
+                       record_name);
+        return(TRACE_MAX_OPS);
+    }
+    shash_add(&record_ops, key, (void *) (uintptr_t) (id + 1));
+
+    if (record_file == NULL) {
+        return(id);
+    }
+
+    len = strlen(subsystem) + 1 + strlen(op->device) + 1;
+    memset(&rec, 0, sizeof rec);
+    rec.time = time_usec();
+    rec.value = op->bit_mask;
+    rec.rc = op->register_address;
+    rec.op = id;
+    rec.type = TRACE_REC_DEFINE;
+    rec.latency = len;
+    if (fwrite(&rec, sizeof rec, 1, record_file) != 1
+        || fwrite(subsystem, strlen(subsystem) + 1, 1, record_file) != 1
+        || fwrite(op->device, strlen(op->device) + 1, 1, record_file) != 1) {
+        trace_record_error(errno);
+    }
+
+    return(id);
+}
+
+/************************************************************************//**
+ * Function that records one register access. Called by the worker thread
+ * that owns "ring"; never blocks.
+ ***************************************************************************/
+void
+powerd_trace_put(struct powerd_trace_ring *ring, uint16_t op, bool write,
+                 uint32_t value, int rc, long long int start,
+                 long long int latency)
+{
+    struct powerd_trace_rec *rec;
+    uint64_t head, tail, orig;
+
+    if (op == TRACE_MAX_OPS) {
+        return;
+    }
+
+    atomic_read_relaxed(&ring->head, &head);
+    atomic_read_explicit(&ring->tail, &tail, memory_order_acquire);
+    if (head - tail >= TRACE_RING_SIZE) {
+        atomic_add_relaxed(&ring->drops, 1, &orig);
+        return;
+    }
+
+    rec = &ring->recs[head & TRACE_RING_MASK];
+    rec->time = start;
+    rec->value = value;
+    rec->rc = rc;
+    rec->op = op;
+    rec->type = write ? TRACE_REC_WRITE : TRACE_REC_READ;
+    rec->pad = 0;
+    rec->latency = latency;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* move the records buffered by the workers into the trace file */
+void
+powerd_trace_run(void)
+{
+    struct powerd_trace_ring *ring;
+    bool written = false;
+
+    for (ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head, tail;
+
+        atomic_read_explicit(&ring->head, &head, memory_order_acquire);
+        atomic_read_relaxed(&ring->tail, &tail);
+        while (tail != head) {
+            /* the records up to the end of the array, in one write */
+            size_t first = tail & TRACE_RING_MASK;
+            size_t n = MIN(head - tail, TRACE_RING_SIZE - first);
+
+            if (record_file != NULL
+                && fwrite(&ring->recs[first], sizeof ring->recs[0], n,
+                          record_file) != n) {
+                trace_record_error(errno);
+            }
+            recorded += n;
+            tail += n;
+            written = true;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    if (written && record_file != NULL && fflush(record_file) != 0) {
+        trace_record_error(errno);
+    }
+}
+
+/* append a record to the key it belongs to */
+static void
+trace_key_add(const char *name, const struct powerd_trace_rec *rec)
+{
+    struct trace_key *key = shash_find_data(&replay_keys, name);
+
+    if (key == NULL) {
+        key = xzalloc(sizeof *key);
+        shash_add(&replay_keys, name, key);
+    }
+    if (key->n_recs >= key->allocated) {
+        key->recs = x2nrealloc(key->recs, &key->allocated, sizeof *key->recs);
+    }
+    key->recs[key->n_recs++] = *rec;
+}
+
+/* load the records of a trace into replay_keys */
+static int
+trace_load(FILE *stream, const char *file)
+{
+    struct powerd_trace_header header;
+    struct powerd_trace_rec rec;
+    char **ops = NULL;
+    size_t n_ops = 0;
+    size_t allocated = 0;
+    size_t i;
+    int error = 0;
+
+    if (fread(&header, sizeof header, 1, stream) != 1
+        || header.magic != TRACE_MAGIC) {
+        VLOG_ERR("%s: not a register trace", file);
+        return(EINVAL);
+    }
+    if (header.version != TRACE_VERSION) {
+        VLOG_ERR("%s: unsupported trace version %u", file, header.version);
+        return(EINVAL);
+    }
+    trace_start = header.start;
+
+    while (fread(&rec, sizeof rec, 1, stream) == 1) {
+        if (rec.type == TRACE_REC_DEFINE) {
+            char names[512];
+            char *device;
+            char key[256];
+
+            if (rec.latency > sizeof names || rec.op != n_ops
+                || fread(names, rec.latency, 1, stream) != 1
+                || names[rec.latency - 1] != '\0'
+                || (device = memchr(names, '\0', rec.latency - 1)) == NULL) {
+                error = EINVAL;
+                break;
+            }
+            device++;
+            snprintf(key, sizeof key, "%s/%s/%x/%x", names, device,
+                     (unsigned int) rec.rc, (unsigned int) rec.value);
+            if (n_ops >= allocated) {
+                ops = x2nrealloc(ops, &allocated, sizeof *ops);
+            }
+            ops[n_ops++] = xstrdup(key);
+        } else if (rec.type == TRACE_REC_READ
+                   || rec.type == TRACE_REC_WRITE) {
+            char *name;
+
+            if (rec.op >= n_ops) {
+                error = EINVAL;
+                break;
+            }
+            name = xasprintf("%s/%c", ops[rec.op],
+                             rec.type == TRACE_REC_WRITE ? 'w' : 'r');
+            trace_key_add(name, &rec);
+            free(name);
+        } else {
+            error = EINVAL;
+            break;
+        }
+    }
+    if (error) {
+        VLOG_ERR("%s: corrupt trace", file);
+    }
+
+    for (i = 0; i < n_ops; i++) {
+        free(ops[i]);
+    }
+    free(ops);
+
+    return(error);
+}
+
+/************************************************************************//**
+ * Function that loads the trace in "file" and answers every register
+ * access from it from then on.
+ *
+ * With "realtime", each access waits for its recorded time, relative to
+ * the start of the replay, and takes its recorded duration. Returns 0 on
+ * success, otherwise an errno value.
+ ***************************************************************************/
+int
+powerd_trace_replay_open(const char *file, bool realtime)
+{
+    FILE *stream;
+    int error;
+
+    stream = fopen(file, "rb");
+    if (stream == NULL) {
+        return(errno);
+    }
+    error = trace_load(stream, file);
+    fclose(stream);
+    if (error) {
+        return(error);
+    }
+
+    replay_name = xstrdup(file);
+    replay_realtime = realtime;
+    replay_start = time_usec();
+    replaying = true;
+    VLOG_INFO("%s: replaying %zu registers%s", file,
+              shash_count(&replay_keys), realtime ? " in real time" : "");
+
+    return(0);
+}
+
+/************************************************************************//**
+ * Function that answers a register access from the trace being replayed.
+ *
+ * Called by the worker thread of the bus the register is on; every key is
+ * only ever replayed by that worker, so no locking is needed. Returns the
+ * recorded result, and for reads the recorded value. A register that was
+ * never recorded, or whose records are used up, fails with EIO.
+ ***************************************************************************/
+int
+powerd_trace_replay_op(const char *subsystem, const i2c_bit_op *op,
+                       bool write, uint32_t *value)
+{
+    const struct powerd_trace_rec *rec;
+    struct trace_key *key;
+    char name[256];
+    size_t len;
+
+    trace_key_format(name, sizeof name - 2, subsystem, op);
+    len = strlen(name);
+    name[len++] = '/';
+    name[len++] = write ? 'w' : 'r';
+    name[len] = '\0';
+
+    key = shash_find_data(&replay_keys, name);
+    if (key == NULL || key->cursor >= key->n_recs) {
+        if (key != NULL && !key->exhausted) {
+            VLOG_WARN("%s: no more records for %s", replay_name, name);
+            key->exhausted = true;
+        }
+        return(EIO);
+    }
+    rec = &key->recs[key->cursor++];
+
+    if (replay_realtime) {
+        long long int due = replay_start + (rec->time - trace_start);
+        long long int now = time_usec();
+
+        if (due > now) {
+            xnanosleep((due - now) * 1000);
+        }
+        if (rec->latency > 0) {
+            xnanosleep(rec->latency * 1000LL);
+        }
+    }
+
+    if (!write) {
+        *value = rec->value;
+    }
+    return(rec->rc);
+}
+
+/* report trace state for ops-powerd/dump */
+void
+powerd_trace_dump(struct ds *ds)
+{
+    if (recording) {
+        struct powerd_trace_ring *ring;
+        unsigned long long int drops = 0;
+
+        for (ring = rings; ring != NULL; ring = ring->next) {
+            uint64_t n;
+
+            atomic_read_relaxed(&ring->drops, &n);
+            drops += n;
+        }
+        ds_put_format(ds, "Trace: recording to %s%s, %zu registers, "
+                      "%llu accesses, %llu dropped\n", record_name,
+                      record_file == NULL ? " (stopped)" : "",
+                      shash_count(&record_ops), recorded, drops);
+    } else if (replaying) {
+        struct shash_node *node;
+        unsigned long long int total = 0;
+        unsigned long long int replayed = 0;
+
+        SHASH_FOR_EACH(node, &replay_keys) {
+            const struct trace_key *key = node->data;
+
+            total += key->n_recs;
+            replayed += key->cursor;
+        }
+        ds_put_format(ds, "Trace: replaying %s%s, %llu of %llu accesses\n",
+                      replay_name, replay_realtime ? " in real time" : "",
+                      replayed, total);
+    }
+}
+
+/* flush and close the trace; called once the i2c workers have stopped */
+void
+powerd_trace_close(void)
+{
+    struct shash_node *node;
+
+    if (recording) {
+        powerd_trace_run();
+        if (record_file != NULL) {
+            fclose(record_file);
+            record_file = NULL;
+        }
+        while (rings != NULL) {
+            struct powerd_trace_ring *next = rings->next;
+
+            free(rings);
+            rings = next;
+        }
+        shash_destroy(&record_ops);
+        recording = false;
+    }
+
+    if (replaying) {
+        SHASH_FOR_EACH(node, &replay_keys) {
+            struct trace_key *key = node->data;
+
+            free(key->recs);
+            free(key);
+        }
+        shash_destroy(&replay_keys);
+        replaying = false;
+    }
+}
@@ -0,0 +1,230 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for watching the hardware description directories
+ ***************************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "poll-loop.h"
+#include "shash.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "powerd_watch.h"
+
+VLOG_DEFINE_THIS_MODULE(powerd_watch);
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                      IN_MOVED_FROM | IN_MOVED_TO)
+
+/* the watch on one subsystem's directory */
+struct powerd_watch {
+    int wd;                           /* inotify watch descriptor, -1 while
+                                         the directory is not watched */
+    char *dir;
+};
+
+static int watch_fd = -1;
+static powerd_watch_cb *watch_cb;
+
+/* watches by subsystem name */
+static struct shash watches = SHASH_INITIALIZER(&watches);
+
+/************************************************************************//**
+ * Function that sets up inotify. Hardware descriptions are only reloaded
+ * on change if this succeeds; otherwise an error is logged and the daemon
+ * runs as before.
+ ***************************************************************************/
+void
+powerd_watch_init(powerd_watch_cb *cb)
+{
+    watch_cb = cb;
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0) {
+        VLOG_ERR("hardware descriptions will not be reloaded on change "
+                 "(%s)", ovs_strerror(errno));
+    }
+}
+
+void
+powerd_watch_exit(void)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &watches) {
+        struct powerd_watch *watch = node->data;
+
+        free(watch->dir);
+        free(watch);
+    }
+    shash_clear(&watches);
+
+    if (watch_fd >= 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+}
+
+/************************************************************************//**
+ * Function that starts watching the description directory of a subsystem,
+ * or watches it again if it went away, as when it is removed or replaced
+ * by an upgrade.
+ *
+ * Called again on every reconfigure and reload attempt; a directory that
+ * cannot be watched is only warned about once and tried again then.
+ *
+ * Returns: true if the directory is watched from now on, so changes made
+ *          to it while it was not may have been missed
+ ***************************************************************************/
+bool
+powerd_watch_add(const char *subsystem, const char *dir)
+{
+    struct powerd_watch *watch;
+    int wd;
+
+    if (watch_fd < 0) {
+        return(false);
+    }
+    watch = shash_find_data(&watches, subsystem);
+    if (watch != NULL && watch->wd >= 0) {
+        return(false);
+    }
+
+    wd = inotify_add_watch(watch_fd, dir, WATCH_EVENTS);
+    if (wd < 0) {
+        if (watch == NULL) {
+            VLOG_WARN("subsystem %s: cannot watch %s (%s)", subsystem, dir,
+                      ovs_strerror(errno));
+            watch = xmalloc(sizeof *watch);
+            watch->wd = -1;
+            watch->dir = xstrdup(dir);
+            shash_add(&watches, subsystem, watch);
+        }
+        return(false);
+    }
+
+    if (watch == NULL) {
+        watch = xmalloc(sizeof *watch);
+        watch->dir = xstrdup(dir);
+        shash_add(&watches, subsystem, watch);
+        VLOG_DBG("subsystem %s: watching %s", subsystem, dir);
+    } else {
+        VLOG_INFO("subsystem %s: watching %s again", subsystem, dir);
+    }
+    watch->wd = wd;
+    return(true);
+}
+
+void
+powerd_watch_remove(const char *subsystem)
+{
+    struct powerd_watch *watch = shash_find_and_delete(&watches, subsystem);
+    struct shash_node *node;
+
+    if (watch == NULL) {
+        return;
+    }
+    if (watch->wd < 0) {
+        goto out;
+    }
+
+    /* subsystems sharing a directory share its watch descriptor */
+    SHASH_FOR_EACH(node, &watches) {
+        const struct powerd_watch *other = node->data;
+
+        if (other->wd == watch->wd) {
+            goto out;
+        }
+    }
+    inotify_rm_watch(watch_fd, watch->wd);
+
+out:
+    free(watch->dir);
+    free(watch);
+}
+
+/* report the file named in one event to every subsystem watching it */
+static void
+powerd_watch_event(const struct inotify_event *event)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH(node, &watches) {
+        struct powerd_watch *watch = node->data;
+
+        if (watch->wd != event->wd) {
+            continue;
+        }
+        if (event->mask & IN_IGNORED) {
+            /* the directory itself went away; powerd_watch_add() watches
+               it again once it is back */
+            VLOG_WARN("subsystem %s: %s is no longer watched", node->name,
+                      watch->dir);
+            watch->wd = -1;
+        } else if (event->len > 0) {
+            watch_cb(node->name, event->name);
+        }
+    }
+}
+
+/* read pending change events and report them */
+void
+powerd_watch_run(void)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 60);
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    if (watch_fd < 0) {
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = read(watch_fd, buf, sizeof buf);
+        char *p;
+
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                VLOG_WARN_RL(&rl, "reading change events failed (%s)",
+                             ovs_strerror(errno));
+            }
+            break;
+        }
+
+        for (p = buf; p < buf + n;
+             p += sizeof(struct inotify_event)
+                  + ((struct inotify_event *) p)->len) {
+            powerd_watch_event((struct inotify_event *) p);
+        }
+    }
+}
+
+void
+powerd_watch_wait(void)
+{
+    if (watch_fd >= 0) {
+        poll_fd_wait(watch_fd, POLLIN);
+    }
+}
@@ -0,0 +1,296 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Benchmark of the ops-powerd shared memory psu snapshot
+ *
+ * Compares reading psu status from the snapshot, in place and through the
+ * reader library, with reading it from the db with a select of the
+ * Power_supply table, the round trip that a daemon without an IDL replica
+ * of the table would pay. ops-powerd and ovsdb-server must be running.
+ ***************************************************************************/
+
+#include "config.h"
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dirs.h"
+#include "json.h"
+#include "jsonrpc.h"
+#include "stream.h"
+#include "util.h"
+#include "vswitch-idl.h"
+#include "powerd_shm.h"
+
+/* db round trips are this many times fewer than snapshot reads */
+#define DB_RATIO  1000
+
+OVS_NO_RETURN static void usage(void);
+
+static long long int
+bench_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+static int
+compare_llong(const void *a_, const void *b_)
+{
+    const long long int *a = a_, *b = b_;
+
+    return(*a < *b ? -1 : *a > *b);
+}
+
+static void
+bench_report(const char *what, long long int *samples, int n)
+{
+    long long int total = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        total += samples[i];
+    }
+    qsort(samples, n, sizeof *samples, compare_llong);
+    printf("%-24s %10d %12.1f %12lld %12lld\n", what, n, (double) total / n,
+           samples[n / 2], samples[n - 1 - n / 100]);
+}
+
+/* reads are timed in batches, a single one is shorter than the clock */
+#define BATCH  100
+
+/* read the status of one psu in place, without a copy */
+static void
+bench_shm_inplace(const struct powerd_shm_reader *reader, int id,
+                  long long int *samples, int n)
+{
+    volatile uint32_t sink;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        long long int start = bench_nsec();
+
+        for (j = 0; j < BATCH; j++) {
+            uint64_t seq;
+            uint32_t status;
+
+            do {
+                seq = powerd_shm_read_begin(reader->seg);
+                status = reader->seg->psus[id].status;
+            } while (powerd_shm_read_retry(reader->seg, seq));
+            sink = status;
+        }
+        samples[i] = (bench_nsec() - start) / BATCH;
+    }
+    (void) sink;
+}
+
+static void
+bench_shm_psu(const struct powerd_shm_reader *reader, int id,
+              long long int *samples, int n)
+{
+    struct powerd_shm_psu psu;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        long long int start = bench_nsec();
+
+        for (j = 0; j < BATCH; j++) {
+            if (powerd_shm_read_psu(reader, id, &psu, NULL)) {
+                ovs_fatal(0, "reading psu %d failed", id);
+            }
+        }
+        samples[i] = (bench_nsec() - start) / BATCH;
+    }
+}
+
+static void
+bench_shm_snapshot(const struct powerd_shm_reader *reader,
+                   long long int *samples, int n)
+{
+    struct powerd_shm_segment snapshot;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        long long int start = bench_nsec();
+
+        for (j = 0; j < BATCH; j++) {
+            if (powerd_shm_read(reader, &snapshot)) {
+                ovs_fatal(0, "reading the snapshot failed");
+            }
+        }
+        samples[i] = (bench_nsec() - start) / BATCH;
+    }
+}
+
+/* select the name and status of every psu from the db */
+static void
+bench_db(const char *remote, long long int *samples, int n)
+{
+    struct jsonrpc *rpc;
+    struct stream *stream;
+    int error, i;
+
+    error = stream_open_block(jsonrpc_stream_open(remote, &stream,
+                                                  DSCP_DEFAULT), &stream);
+    if (error) {
+        ovs_fatal(error, "%s: connection failed", remote);
+    }
+    rpc = jsonrpc_open(stream);
+
+    for (i = 0; i < n; i++) {
+        struct jsonrpc_msg *request, *reply;
+        struct json *op, *params;
+        long long int start;
+
+        op = json_object_create();
+        json_object_put_string(op, "op", "select");
+        json_object_put_string(op, "table", "Power_supply");
+        json_object_put(op, "where", json_array_create_empty());
+        json_object_put(op, "columns",
+                        json_array_create_2(json_string_create("name"),
+                                            json_string_create("status")));
+        params = json_array_create_2(
+            json_string_create(ovsrec_idl_class.database), op);
+        request = jsonrpc_create_request("transact", params, NULL);
+
+        start = bench_nsec();
+        error = jsonrpc_transact_block(rpc, request, &reply);
+        samples[i] = bench_nsec() - start;
+        if (error) {
+            ovs_fatal(error, "%s: transaction failed", remote);
+        }
+        if (reply->error != NULL) {
+            char *s = json_to_string(reply->error, 0);
+
+            ovs_fatal(0, "%s: transaction failed (%s)", remote, s);
+        }
+        jsonrpc_msg_destroy(reply);
+    }
+
+    jsonrpc_close(rpc);
+}
+
+static void
+usage(void)
+{
+    printf("%s: benchmark of the ops-powerd psu snapshot\n"
+           "usage: %s [OPTIONS] [DATABASE]\n"
+           "where DATABASE is a socket on which ovsdb-server is listening\n"
+           "      (default: \"unix:%s/db.sock\").\n"
+           "\nOptions:\n"
+           "  -n, --iterations=N      time N batches of %d snapshot reads "
+           "(default: 10000)\n"
+           "                          and N/%d db round trips\n"
+           "  -s, --segment=NAME      read the snapshot NAME (default: %s)\n"
+           "  -h, --help              display this help message\n",
+           program_name, program_name, ovs_rundir(), BATCH, DB_RATIO,
+           POWERD_SHM_NAME);
+    exit(EXIT_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"iterations", required_argument, NULL, 'n'},
+        {"segment",    required_argument, NULL, 's'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    struct powerd_shm_reader reader;
+    const char *segment = POWERD_SHM_NAME;
+    long long int *samples;
+    char *remote;
+    int n = 10000, n_db;
+    int error, id;
+
+    set_program_name(argv[0]);
+
+    for (;;) {
+        int c = getopt_long(argc, argv, "n:s:h", long_options, NULL);
+
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'n':
+            n = atoi(optarg);
+            if (n < 1) {
+                ovs_fatal(0, "--iterations must be at least 1");
+            }
+            break;
+        case 's':
+            segment = optarg;
+            break;
+        case 'h':
+            usage();
+        default:
+            exit(EXIT_FAILURE);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc > 1) {
+        ovs_fatal(0, "at most one non-option argument accepted; "
+                  "use --help for usage");
+    }
+    remote = argc == 1 ? xstrdup(argv[0])
+                       : xasprintf("unix:%s/db.sock", ovs_rundir());
+
+    error = powerd_shm_reader_open(&reader, segment);
+    if (error) {
+        ovs_fatal(error, "%s: cannot open the psu snapshot", segment);
+    }
+
+    /* the first psu in the snapshot */
+    for (id = 0; id < reader.seg->n_psus; id++) {
+        if (reader.seg->psus[id].flags & POWERD_SHM_PSU_USED) {
+            break;
+        }
+    }
+    if (id == reader.seg->n_psus) {
+        ovs_fatal(0, "%s: no psus in the snapshot", segment);
+    }
+
+    n_db = MAX(n / DB_RATIO, 10);
+    samples = xmalloc(MAX(n, n_db) * sizeof *samples);
+
+    printf("%-24s %10s %12s %12s %12s\n", "read (ns)", "samples", "mean",
+           "p50", "p99");
+    bench_shm_inplace(&reader, id, samples, n);
+    bench_report("snapshot, in place", samples, n);
+    bench_shm_psu(&reader, id, samples, n);
+    bench_report("snapshot, one psu", samples, n);
+    bench_shm_snapshot(&reader, samples, n);
+    bench_report("snapshot, all psus", samples, n);
+    bench_db(remote, samples, n_db);
+    bench_report("db select", samples, n_db);
+
+    free(samples);
+    free(remote);
+    powerd_shm_reader_close(&reader);
+    return(0);
+}
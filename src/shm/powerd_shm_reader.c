@@ -0,0 +1,193 @@
+/*
+ * (c) Copyright 2015 Hewlett Packard Enterprise Development LP
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *   not use this file except in compliance with the License. You may obtain
+ *   a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *   WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *   License for the specific language governing permissions and limitations
+ *   under the License.
+ */
+
+/************************************************************************//**
+ * @ingroup ops-powerd
+ *
+ * @file
+ * Source file for reading the ops-powerd shared memory psu snapshot
+ *
+ * This library only depends on the C library, so that any local daemon
+ * can link it. Reads never block: a read that keeps overlapping with
+ * writes gives up with EAGAIN, which can only happen if the writer died
+ * in the middle of a write.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "powerd_shm.h"
+
+/* attempts to read a consistent state before giving up */
+#define READ_TRIES  1000
+
+/************************************************************************//**
+ * Function that maps the snapshot segment for reading.
+ *
+ * @param[out] reader - the mapped segment
+ * @param[in]  name   - name of the segment, NULL for POWERD_SHM_NAME
+ *
+ * @return 0 on success, ENOENT if ops-powerd has not created the segment
+ *         yet, EPROTO if its layout is not the one of this header, other
+ *         errno values on failure
+ ***************************************************************************/
+int
+powerd_shm_reader_open(struct powerd_shm_reader *reader, const char *name)
+{
+    const struct powerd_shm_segment *seg;
+    struct stat st;
+    int fd, error;
+
+    reader->seg = NULL;
+    reader->size = 0;
+
+    fd = shm_open(name != NULL ? name : POWERD_SHM_NAME, O_RDONLY | O_CLOEXEC,
+                  0);
+    if (fd < 0) {
+        return(errno);
+    }
+    if (fstat(fd, &st) < 0) {
+        error = errno;
+        close(fd);
+        return(error);
+    }
+    if (st.st_size != sizeof *seg) {
+        close(fd);
+        return(EPROTO);
+    }
+
+    seg = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    error = seg == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (error) {
+        return(error);
+    }
+
+    if (seg->magic != POWERD_SHM_MAGIC || seg->version != POWERD_SHM_VERSION
+        || seg->size != sizeof *seg || seg->psu_size != sizeof seg->psus[0]) {
+        munmap((void *) seg, st.st_size);
+        return(EPROTO);
+    }
+
+    reader->seg = seg;
+    reader->size = st.st_size;
+    return(0);
+}
+
+void
+powerd_shm_reader_close(struct powerd_shm_reader *reader)
+{
+    if (reader->seg != NULL) {
+        munmap((void *) reader->seg, reader->size);
+        reader->seg = NULL;
+        reader->size = 0;
+    }
+}
+
+/* copy the whole segment; returns 0 or EAGAIN */
+int
+powerd_shm_read(const struct powerd_shm_reader *reader,
+                struct powerd_shm_segment *snapshot)
+{
+    int try;
+
+    for (try = 0; try < READ_TRIES; try++) {
+        uint64_t seq = powerd_shm_read_begin(reader->seg);
+
+        memcpy(snapshot, reader->seg, sizeof *snapshot);
+        if (!powerd_shm_read_retry(reader->seg, seq)) {
+            return(0);
+        }
+    }
+
+    return(EAGAIN);
+}
+
+/************************************************************************//**
+ * Function that copies the state of one psu.
+ *
+ * @param[in]  reader     - the mapped segment
+ * @param[in]  id         - id of the psu, from powerd_shm_find()
+ * @param[out] psu        - state of the psu
+ * @param[out] generation - if nonnull, the generation the id belongs to
+ *
+ * @return 0 on success, ENOENT if the slot is free, EINVAL if the id is out
+ *         of range, EAGAIN if no consistent state could be read
+ ***************************************************************************/
+int
+powerd_shm_read_psu(const struct powerd_shm_reader *reader, int id,
+                    struct powerd_shm_psu *psu, uint64_t *generation)
+{
+    int try;
+
+    if (id < 0 || id >= POWERD_SHM_MAX_PSUS) {
+        return(EINVAL);
+    }
+
+    for (try = 0; try < READ_TRIES; try++) {
+        uint64_t seq = powerd_shm_read_begin(reader->seg);
+
+        *psu = reader->seg->psus[id];
+        if (generation != NULL) {
+            *generation = reader->seg->generation;
+        }
+        if (!powerd_shm_read_retry(reader->seg, seq)) {
+            return(psu->flags & POWERD_SHM_PSU_USED ? 0 : ENOENT);
+        }
+    }
+
+    return(EAGAIN);
+}
+
+/* look up the id of a psu by name; returns it, or a negative errno value */
+int
+powerd_shm_find(const struct powerd_shm_reader *reader, const char *name,
+                uint64_t *generation)
+{
+    int try;
+
+    for (try = 0; try < READ_TRIES; try++) {
+        uint64_t seq = powerd_shm_read_begin(reader->seg);
+        uint32_t n_psus = reader->seg->n_psus;
+        int id = -ENOENT;
+        int i;
+
+        if (n_psus > POWERD_SHM_MAX_PSUS) {
+            n_psus = POWERD_SHM_MAX_PSUS;
+        }
+        for (i = 0; i < n_psus; i++) {
+            const struct powerd_shm_psu *psu = &reader->seg->psus[i];
+
+            if (psu->flags & POWERD_SHM_PSU_USED &&
+                strncmp(psu->name, name, sizeof psu->name) == 0) {
+                id = i;
+                break;
+            }
+        }
+        if (generation != NULL) {
+            *generation = reader->seg->generation;
+        }
+        if (!powerd_shm_read_retry(reader->seg, seq)) {
+            return(id);
+        }
+    }
+
+    return(-EAGAIN);
+}